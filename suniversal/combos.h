@@ -0,0 +1,79 @@
+/*
+    combos - keys pressed together that send something else
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMBOS_h
+#define COMBOS_h
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "usb_codes.h"
+
+/*
+    A combo is two or three keys pressed within COMBO_TERM of each other.
+    It sends its code (as in sun_to_usb.h, so also macros or layer keys)
+    instead of the keys, until the first of them is released.
+
+    Keys that are part of a combo get held back while they could still turn
+    into one, and are passed on as soon as that's no longer possible, i.e.
+    when a key comes along that doesn't fit, a key gets released, or
+    COMBO_TERM runs out. All other keys are not delayed.
+ */
+#define COMBO_MAX_KEYS 3
+
+struct Combo {
+    uint8_t keys[COMBO_MAX_KEYS]; // SUN scan codes, unused ones 0 at the end
+    uint16_t code;
+};
+
+static constexpr Combo combos[] PROGMEM = {
+    // both Triangle keys: Super-L, locks the screen on many desktops
+    {{0x78, 0x7A, 0}, USB_MOD_LMETA << 8 | USB_L}
+};
+
+/*
+    Bit map of all keys that are part of some combo, one bit per SUN scan
+    code, computed by the compiler from the table above. That's how keys
+    that can't start a combo get passed on right away.
+ */
+constexpr bool inCombo(uint8_t key, uint8_t i = 0, uint8_t j = 0) {
+    return i == array_len(combos) ? false :
+        j == COMBO_MAX_KEYS ? inCombo(key, i + 1, 0) :
+        key != 0 && combos[i].keys[j] == key ? true :
+        inCombo(key, i, j + 1);
+}
+
+#define COMBO_BIT(k, b) (inCombo((k) + (b)) ? 1 << (b) : 0)
+#define COMBO_BYTE(k) \
+    (COMBO_BIT(k, 0) | COMBO_BIT(k, 1) | COMBO_BIT(k, 2) | COMBO_BIT(k, 3) | \
+     COMBO_BIT(k, 4) | COMBO_BIT(k, 5) | COMBO_BIT(k, 6) | COMBO_BIT(k, 7))
+#define COMBO_BYTES_32(k) \
+    COMBO_BYTE(k), COMBO_BYTE((k) + 8), \
+    COMBO_BYTE((k) + 16), COMBO_BYTE((k) + 24)
+
+static constexpr uint8_t comboKeys[16] PROGMEM = {
+    COMBO_BYTES_32(0x00), COMBO_BYTES_32(0x20),
+    COMBO_BYTES_32(0x40), COMBO_BYTES_32(0x60)
+};
+
+static_assert(comboKeys[0x78 >> 3] & 1 << (0x78 & 0x07),
+    "L-Triangle should be in combo map");
+
+#endif
@@ -12,6 +12,23 @@
 //
 #define USE_MOUSE true
 
+// Baud rate of the mouse. SUN mice use 1200.
+//
+#define MOUSE_BAUD 1200
+
+// Set whether to detect the baud rate of the mouse, for faster mice. This
+// starts with MOUSE_BAUD, and when that doesn't give proper frames, measures
+// the rate on the RX pin. Supported are 1200, 2400, 4800, 9600, and 19200.
+//
+#define DETECT_MOUSE_BAUD false
+
+
+// Set whether to use a second keyboard. It's connected to the H/W serial,
+// which on the Pro Micro is Serial1, so this can't be used together with
+// USE_MOUSE. Both keyboards show up as one keyboard on the host.
+//
+#define USE_SECOND_KEYBOARD false
+
 
 // Set whether to emulate a mouse scroll wheel, i.e. scroll up/down and
 // left/right, when the mouse is moved up/down and left/right with the
@@ -28,12 +45,145 @@
 #define INVERTED_SCROLLING false
 
 
+// Set whether to smooth mouse motion. The mouse reports motion only about 20
+// to 40 times a second, so the pointer moves in visible steps. With this on,
+// motion is spread over the USB polls in between. This adds some latency, at
+// most MOUSE_INTERPOLATION_LATENCY milliseconds.
+//
+#define INTERPOLATE_MOUSE false
+#define MOUSE_INTERPOLATION_LATENCY 50
+
+
+// Set whether to use mouse keys, i.e. move the mouse pointer with the keypad.
+// This needs USE_LAYERS. Line_Feed + Num_Lock toggles mouse keys on, and
+// Num_Lock toggles them off again. See layers.h for the keys.
+//
+#define USE_MOUSE_KEYS false
+
+// Speeds of the mouse keys pointer, in pixels per second. It starts moving at
+// the min speed, and reaches max speed after MOUSE_KEYS_ACCEL_TIME
+// milliseconds.
+//
+#define MOUSE_KEYS_SPEED_MIN  50
+#define MOUSE_KEYS_SPEED_MAX  1200
+#define MOUSE_KEYS_ACCEL_TIME 1500
+
+
+// Set whether to send the volume, mute, and power keys as Consumer Control and
+// System Control reports, which work with all common hosts. Otherwise, they
+// send the corresponding keyboard keys, which not all hosts understand. With
+// USE_LAYERS, Line_Feed + Mute is play/pause, Line_Feed + Volume_Decr and
+// Volume_Incr skip tracks, and Line_Feed + Power puts the host to sleep.
+//
+#define USE_MEDIA_KEYS true
+
+
 // Set whether to use macros instead of single codes for the special keys in the
 // fun cluster.
 //
 #define USE_MACROS true
 
 
+// Set whether to accept a user keymap from the host, which overrides some of
+// the built-in key translations and gets stored in EEPROM. It's uploaded as a
+// feature report to the keyboard interface, see keymap.h for the format.
+//
+#define USE_USER_KEYMAP true
+
+
+// Set whether to use keymap layers. While Line_Feed is held, layer 1 is on,
+// which gives F13 through F24 on the function keys, and cursor keys on H/J/K/L.
+// See layers.h for changing or adding layers.
+//
+#define USE_LAYERS true
+
+
+// Set whether to use dual role keys, which do one thing when tapped, and
+// another when held. By default, Caps Lock is Escape when tapped and Control
+// when held, and Compose is Compose when tapped and Meta when held. See
+// tap_hold.h for changing this.
+//
+#define USE_TAP_HOLD false
+
+// How long in milliseconds a dual role key needs to be held down to count as
+// held, when no other key decides it earlier.
+//
+#define TAPPING_TERM 200
+
+// When true, a dual role key counts as held as soon as another key has been
+// pressed and released while it's down, even if TAPPING_TERM hasn't run out.
+//
+#define PERMISSIVE_HOLD true
+
+
+// Set whether to use combos, i.e. keys pressed together that send something
+// else. By default, pressing both Triangle keys sends Super-L, which locks the
+// screen on many desktops. See combos.h for setting up your own combos.
+//
+#define USE_COMBOS false
+
+// Max time in milliseconds between the first and the last key of a combo.
+//
+#define COMBO_TERM 50
+
+
+// Set whether to use leader key sequences. The Help key then starts a
+// sequence of keys that runs a macro, e.g. Help G S types "git status". This
+// needs USE_MACROS. See leader.h for setting up your own sequences.
+//
+#define USE_LEADER false
+
+// Time in milliseconds after which an unfinished leader sequence is dropped.
+//
+#define LEADER_TIMEOUT 1000
+
+
+// Set whether to use the key recorder. With USE_LAYERS, while Line_Feed is
+// held, Stop, Props, Front, and Open start and stop recording into one of four
+// slots, and Again, Undo, Copy, and Paste play them back. Recordings are kept
+// in EEPROM.
+//
+#define USE_RECORDER false
+
+// Set whether recordings are played back at the tempo they were recorded in.
+// Otherwise, they're played as fast as the host accepts key reports.
+//
+#define RECORDER_TEMPO false
+
+
+// Set whether to handle USB suspend. While the host is suspended, the
+// keyboard LEDs are off, and the adapter sleeps between interrupts. Any key or
+// mouse button then wakes up the host, without being typed or clicked.
+// Otherwise, only the Power key wakes up the host.
+//
+#define USE_SUSPEND false
+
+
+// Set whether to report diagnostics on the USB serial port, e.g. /dev/ttyACM0
+// on Linux. Send anything to the port, and the adapter answers with all the
+// counters the enabled features keep, one per line. See diagnostics.h.
+//
+#define USE_DIAGNOSTICS false
+
+// Set whether to profile SRAM use. The free SRAM gets painted at start up, so
+// the deepest point the stack ever reached can be found later. Heap size and
+// the bytes waiting in the serial RX buffers are tracked as well. Read this
+// with USE_DIAGNOSTICS. See sram.h.
+//
+#define PROFILE_SRAM false
+
+// Set whether to audit how long interrupts are kept off, e.g. by SoftwareSerial
+// or the USB core, which is what makes us lose mouse bytes or miss USB polls.
+// A timer interrupt probes every IRQ_PROBE_PERIOD microseconds, and probes
+// coming in IRQ_LATE microseconds or more late are recorded along with where
+// the code was. This takes Timer3. Read this with USE_DIAGNOSTICS. See
+// irq_audit.h.
+//
+#define PROFILE_IRQS false
+#define IRQ_PROBE_PERIOD 250
+#define IRQ_LATE 50
+
+
 // When compose mode is true, the LED will turn on when the key is pressed, and
 // go off after the next two key strokes, or when Compose is pressed again. This
 // is meant for when you assign the key to actual compose on the host. When
@@ -0,0 +1,116 @@
+/*
+    diagnostics - runtime counters on the USB serial port
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "diagnostics.h"
+#include "irq_audit.h"
+#include "mouse.h"
+#include "power.h"
+#include "sram.h"
+
+/*
+
+ */
+static void print(const __FlashStringHelper* name, uint32_t value) {
+    Serial.print(name);
+    Serial.print(' ');
+    Serial.println(value);
+}
+
+#if PROFILE_IRQS == true
+/*
+    One line per place, with its byte address in hex, as avr-objdump shows
+    it, and the longest time in us, and how often.
+ */
+static void print(const __FlashStringHelper* name, IrqWindow* windows) {
+    for (uint8_t i = 0; i < IRQ_AUDIT_SLOTS; i++) {
+        if (windows[i].count == 0) {
+            continue;
+        }
+        Serial.print(name);
+        Serial.print(F(" 0x"));
+        Serial.print(2 * (uint32_t)windows[i].pc, HEX);
+        Serial.print(' ');
+        Serial.print(windows[i].max / IRQ_TICKS_PER_US);
+        Serial.print(' ');
+        Serial.println(windows[i].count);
+    }
+}
+#endif
+
+/*
+    Call from the main loop.
+ */
+void Diagnostics::update() {
+
+    if (!Serial.available()) {
+        return;
+    }
+    while (Serial.available()) {
+        Serial.read();
+    }
+
+#if PROFILE_SRAM == true
+    sramProfiler.scan();
+    print(F("sram.data"), sramStats.data);
+    print(F("sram.heap"), sramStats.heap);
+    print(F("sram.stack"), sramStats.stack);
+    print(F("sram.free"), sramStats.free);
+    print(F("sram.keyboardRx"), sramStats.keyboardRx);
+    print(F("sram.serialRx"), sramStats.serialRx);
+    print(F("sram.keyboardOverflows"), sramStats.keyboardOverflows);
+#endif
+
+#if PROFILE_IRQS == true
+    IrqStats irq;
+    irqAudit.copy(irq);
+    print(F("irq.probes"), irq.probes);
+    print(F("irq.late"), irq.late);
+    print(F("irq.max"), irq.max / IRQ_TICKS_PER_US);
+    print(F("irq.window"), irq.windows);
+    print(F("irq.section"), irq.sections);
+#endif
+
+#if USE_MOUSE == true
+    print(F("mouse.frames"), mouseSync.frames);
+    print(F("mouse.misframes"), mouseSync.misframes);
+    print(F("mouse.dropped"), mouseSync.dropped);
+    print(F("mouse.switches"), mouseSync.switches);
+    print(F("mouse.recovery"), mouseSync.recovery);
+    print(F("mouse.maxRecovery"), mouseSync.maxRecovery);
+#if INTERPOLATE_MOUSE == true
+    print(F("mouse.latency"), mouseLatency.last);
+    print(F("mouse.maxLatency"), mouseLatency.max);
+#endif
+#endif
+
+#if USE_SUSPEND == true
+    print(F("power.suspends"), powerStats.suspends);
+    print(F("power.wakeups"), powerStats.wakeups);
+    print(F("power.wakeLatency"), powerStats.wakeLatency);
+    print(F("power.maxWakeLatency"), powerStats.maxWakeLatency);
+    print(F("power.awake"), powerStats.awake);
+    print(F("power.asleep"), powerStats.asleep);
+#endif
+
+    Serial.println();
+}
+
+Diagnostics diagnostics;
@@ -0,0 +1,47 @@
+/*
+    diagnostics - runtime counters on the USB serial port
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIAGNOSTICS_h
+#define DIAGNOSTICS_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+/*
+    Whenever something arrives on the USB serial port, e.g. /dev/ttyACM0 on
+    Linux, it's dropped, and all counters the enabled features keep are
+    written back, one per line, as name and values separated by blanks,
+    followed by an empty line. For example:
+
+        echo > /dev/ttyACM0; head -n 20 /dev/ttyACM0
+
+    Counters are only ever read here, so this doesn't change what they
+    measure, other than the time the loop takes while writing.
+ */
+class Diagnostics {
+
+public:
+    void update();
+};
+
+extern Diagnostics diagnostics;
+
+#endif
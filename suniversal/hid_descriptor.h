@@ -0,0 +1,137 @@
+/*
+    HID report descriptor helpers
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HID_DESCRIPTOR_h
+#define HID_DESCRIPTOR_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    Short items for writing report descriptors, as per chapter 6.2.2 of
+        http://www.usb.org/developers/hidpage/HID1_11.pdf
+
+    Each macro expands to the prefix byte followed by its data bytes, so a
+    descriptor is just a list of these inside a byte array initializer.
+ */
+#define RD_USAGE_PAGE(p)          0x05, (p)
+#define RD_USAGE_PAGE16(p)        0x06, ((p) & 0xFF), (((p) >> 8) & 0xFF)
+#define RD_USAGE(u)               0x09, (u)
+#define RD_USAGE16(u)             0x0a, ((u) & 0xFF), (((u) >> 8) & 0xFF)
+#define RD_USAGE_MINIMUM(u)       0x19, (u)
+#define RD_USAGE_MAXIMUM(u)       0x29, (u)
+#define RD_USAGE_MAXIMUM16(u)     0x2a, ((u) & 0xFF), (((u) >> 8) & 0xFF)
+#define RD_LOGICAL_MINIMUM(v)     0x15, ((v) & 0xFF)
+#define RD_LOGICAL_MAXIMUM(v)     0x25, ((v) & 0xFF)
+#define RD_LOGICAL_MAXIMUM16(v)   0x26, ((v) & 0xFF), (((v) >> 8) & 0xFF)
+#define RD_REPORT_SIZE(n)         0x75, (n)
+#define RD_REPORT_COUNT(n)        0x95, (n)
+#define RD_REPORT_ID(n)           0x85, (n)
+#define RD_COLLECTION(t)          0xa1, (t)
+#define RD_END_COLLECTION         0xc0
+#define RD_INPUT(f)               0x81, (f)
+#define RD_OUTPUT(f)              0x91, (f)
+#define RD_FEATURE(f)             0xb1, (f)
+
+// usage pages
+#define RD_PAGE_GENERIC_DESKTOP   0x01
+#define RD_PAGE_KEYBOARD          0x07
+#define RD_PAGE_LEDS              0x08
+#define RD_PAGE_BUTTON            0x09
+#define RD_PAGE_CONSUMER          0x0c
+#define RD_PAGE_VENDOR            0xff00
+
+// collection types
+#define RD_PHYSICAL               0x00
+#define RD_APPLICATION            0x01
+
+// main item flags
+#define RD_DATA_ARY_ABS           0x00
+#define RD_DATA_VAR_ABS           0x02
+#define RD_CNST_VAR_ABS           0x03
+#define RD_DATA_VAR_REL           0x06
+
+// main item prefixes with size bits masked out, used for checking
+#define RD_MAIN_INPUT             0x80
+#define RD_MAIN_OUTPUT            0x90
+#define RD_MAIN_FEATURE           0xb0
+
+/*
+    Compile time descriptor walking. These let us check report structs
+    against the descriptor they are supposed to match with static_assert,
+    so the two can't get out of sync unnoticed. Everything here is constexpr
+    and only ever evaluated by the compiler, so there's no runtime cost.
+ */
+constexpr uint8_t rdItemLength(uint8_t prefix) {
+    return (prefix & 0x03) == 0x03 ? 4 : (prefix & 0x03);
+}
+
+constexpr uint16_t rdItemData(const uint8_t* d, size_t i) {
+    return rdItemLength(d[i]) == 0 ? 0 :
+        rdItemLength(d[i]) == 1 ? d[i + 1] : d[i + 1] | (d[i + 2] << 8);
+}
+
+constexpr bool rdIs(const uint8_t* d, size_t i, uint8_t tag) {
+    return (d[i] & 0xFC) == tag;
+}
+
+/*
+    Total number of bits in main items of type `kind` (RD_MAIN_INPUT,
+    RD_MAIN_OUTPUT, or RD_MAIN_FEATURE) for report `id`, not including the
+    report ID byte itself. Use 0 for descriptors without report IDs.
+ */
+constexpr uint16_t rdReportBits(const uint8_t* d, size_t len, uint8_t kind,
+    uint8_t id, size_t i = 0, uint8_t size = 0, uint8_t count = 0,
+    uint8_t current = 0, uint16_t bits = 0) {
+
+    return i >= len ? bits :
+        rdReportBits(d, len, kind, id, i + 1 + rdItemLength(d[i]),
+            rdIs(d, i, 0x74) ? rdItemData(d, i) : size,
+            rdIs(d, i, 0x94) ? rdItemData(d, i) : count,
+            rdIs(d, i, 0x84) ? rdItemData(d, i) : current,
+            rdIs(d, i, kind) && current == id ? bits + size * count : bits);
+}
+
+/*
+    Bit offset of the `n`-th main item of type `kind` (counting from 0)
+    within report `id`.
+ */
+constexpr uint16_t rdFieldOffset(const uint8_t* d, size_t len, uint8_t kind,
+    uint8_t id, uint8_t n, size_t i = 0, uint8_t size = 0, uint8_t count = 0,
+    uint8_t current = 0, uint16_t bits = 0) {
+
+    return i >= len ? 0xFFFF :
+        rdIs(d, i, kind) && current == id && n == 0 ? bits :
+        rdFieldOffset(d, len, kind, id,
+            rdIs(d, i, kind) && current == id ? n - 1 : n,
+            i + 1 + rdItemLength(d[i]),
+            rdIs(d, i, 0x74) ? rdItemData(d, i) : size,
+            rdIs(d, i, 0x94) ? rdItemData(d, i) : count,
+            rdIs(d, i, 0x84) ? rdItemData(d, i) : current,
+            rdIs(d, i, kind) && current == id ? bits + size * count : bits);
+}
+
+// convenience wrappers for descriptors that are arrays
+#define RD_REPORT_BITS(desc, kind, id) \
+    rdReportBits((desc), sizeof(desc), (kind), (id))
+#define RD_FIELD_OFFSET(desc, kind, id, n) \
+    rdFieldOffset((desc), sizeof(desc), (kind), (id), (n))
+
+#endif
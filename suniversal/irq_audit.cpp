@@ -0,0 +1,163 @@
+/*
+    irq_audit - finds out how long interrupts are kept off
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#if PROFILE_IRQS == true
+
+#include "irq_audit.h"
+
+// where the probe interrupted the code, set by the vector below
+extern "C" volatile uint16_t irqProbePC;
+volatile uint16_t irqProbePC;
+
+extern "C" void __vector_irq_probe() __attribute__((signal, used));
+
+/*
+    Timer3 as read from the main loop. 16 bit registers are read through a
+    shared temporary register, so the probe must not come in between.
+ */
+static uint16_t ticks() {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t t = TCNT3;
+    SREG = sreg;
+    return t;
+}
+
+/*
+    The address the probe returns to is on the stack, but how deep depends
+    on what a regular handler pushes, so the vector is naked: it copies the
+    address, and then jumps to the actual handler, which returns from the
+    interrupt. Nothing here touches SREG. The PC is pushed low byte first,
+    so after saving r30, r31, and r29, it's at SP + 4 (high) and SP + 5 (low).
+ */
+ISR(TIMER3_COMPA_vect, ISR_NAKED) {
+    asm volatile(
+        "push r30"                      "\n\t"
+        "push r31"                      "\n\t"
+        "push r29"                      "\n\t"
+        "in r30, __SP_L__"              "\n\t"
+        "in r31, __SP_H__"              "\n\t"
+        "ldd r29, Z+4"                  "\n\t"
+        "sts irqProbePC+1, r29"         "\n\t"
+        "ldd r29, Z+5"                  "\n\t"
+        "sts irqProbePC, r29"           "\n\t"
+        "pop r29"                       "\n\t"
+        "pop r31"                       "\n\t"
+        "pop r30"                       "\n\t"
+        "jmp __vector_irq_probe"        "\n\t"
+    );
+}
+
+/*
+    Named like a vector, so the compiler takes it for an interrupt handler
+    without complaining.
+ */
+void __vector_irq_probe() {
+
+    uint16_t now = TCNT3;
+    uint16_t late = now - OCR3A;
+
+    // when we're more than a period late, the next compare would only come
+    // around after the timer wrapped
+    OCR3A = late >= IRQ_PROBE_TICKS ?
+        now + IRQ_PROBE_TICKS : OCR3A + IRQ_PROBE_TICKS;
+
+    irqStats.probes++;
+    if (late > irqStats.max) {
+        irqStats.max = late;
+    }
+    if (late >= IRQ_LATE_TICKS) {
+        irqStats.late++;
+        irqAudit.record(irqStats.windows, irqProbePC, late);
+    }
+}
+
+/*
+    Start probing. Takes Timer3, in normal mode, i.e. free running.
+ */
+void IrqAudit::begin() {
+    TCCR3A = 0;
+    TCCR3B = _BV(CS31);
+    OCR3A = TCNT3 + IRQ_PROBE_TICKS;
+    TIFR3 = _BV(OCF3A);
+    TIMSK3 |= _BV(OCIE3A);
+}
+
+/*
+    Adds a window to the list, if it's one of the worst so far. A place
+    already on the list just gets updated.
+ */
+void IrqAudit::record(IrqWindow* windows, uint16_t pc, uint16_t ticks) {
+
+    IrqWindow* slot = windows;
+    for (uint8_t i = 0; i < IRQ_AUDIT_SLOTS; i++) {
+        if (windows[i].pc == pc) {
+            slot = &windows[i];
+            break;
+        }
+        if (windows[i].max < slot->max) {
+            slot = &windows[i];
+        }
+    }
+
+    if (slot->pc != pc) {
+        if (ticks <= slot->max) {
+            return;
+        }
+        slot->pc = pc;
+        slot->max = 0;
+        slot->count = 0;
+    }
+
+    slot->count++;
+    if (ticks > slot->max) {
+        slot->max = ticks;
+    }
+}
+
+/*
+    Copy of the stats, taken while the probe can't change them.
+ */
+void IrqAudit::copy(IrqStats& stats) {
+    noInterrupts();
+    stats = irqStats;
+    interrupts();
+}
+
+/*
+    Not inlined, so the return address is in the caller.
+ */
+IrqSection::IrqSection() {
+    site = (uintptr_t)__builtin_return_address(0);
+    start = ticks();
+}
+
+IrqSection::~IrqSection() {
+    // only ever recorded from the main loop, so the probe doesn't get in
+    // the way of updating the list
+    irqAudit.record(irqStats.sections, site, ticks() - start);
+}
+
+IrqStats irqStats;
+IrqAudit irqAudit;
+
+#endif
@@ -0,0 +1,118 @@
+/*
+    irq_audit - finds out how long interrupts are kept off
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IRQ_AUDIT_h
+#define IRQ_AUDIT_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+// Timer3 runs at F_CPU / 8, so at 16MHz, all times are in 0.5us ticks, and
+// windows up to 32ms can be told apart
+#define IRQ_TICKS_PER_US   (F_CPU / 8000000UL)
+#define IRQ_PROBE_TICKS    (IRQ_PROBE_PERIOD * IRQ_TICKS_PER_US)
+#define IRQ_LATE_TICKS     (IRQ_LATE * IRQ_TICKS_PER_US)
+#define IRQ_AUDIT_SLOTS    4
+
+/*
+    A place in the code where interrupts were kept off:
+
+     - pc:    word address, i.e. times 2 for avr-objdump or addr2line
+     - max:   longest time, in ticks
+     - count: how often
+ */
+struct IrqWindow {
+    uint16_t pc;
+    uint16_t max;
+    uint16_t count;
+};
+
+/*
+    What the audit found:
+
+     - probes:   probe interrupts that came in
+     - late:     probes that came in IRQ_LATE us or more after they were due
+     - max:      latest probe, in ticks
+     - windows:  worst places found by the probe; pc is where the probe
+                 interrupted the code, which is right after interrupts were
+                 turned back on, or, when another interrupt handler held up
+                 the probe, wherever the main loop happened to be
+     - sections: worst wrapped sections, by call site
+
+    For each list, the places with the longest windows are kept.
+ */
+struct IrqStats {
+    uint32_t probes;
+    uint16_t late;
+    uint16_t max;
+    IrqWindow windows[IRQ_AUDIT_SLOTS];
+    IrqWindow sections[IRQ_AUDIT_SLOTS];
+};
+
+extern IrqStats irqStats;
+
+#if PROFILE_IRQS == true
+
+/*
+    A timer interrupt probes every IRQ_PROBE_PERIOD us. Since it can only
+    come in when interrupts are on, how late it comes is how long they were
+    off, give or take one period. A window shorter than that may slip by
+    between two probes, but long ones, which are what cost us mouse bytes
+    and USB polls, are always caught.
+
+    Calls that are known to turn interrupts off, e.g. SoftwareSerial writes,
+    can additionally be wrapped with IRQ_SECTION, which times them exactly
+    and records where they were called from. The section lasts until the
+    end of the enclosing block.
+ */
+class IrqAudit {
+
+public:
+    void begin();
+    void record(IrqWindow* windows, uint16_t pc, uint16_t ticks);
+    void copy(IrqStats& stats);
+};
+
+extern IrqAudit irqAudit;
+
+/*
+
+ */
+class IrqSection {
+
+private:
+    uint16_t start;
+    uint16_t site;
+
+public:
+    IrqSection() __attribute__((noinline));
+    ~IrqSection() __attribute__((noinline));
+};
+
+#define IRQ_SECTION() IrqSection _irqSection
+
+#else
+
+#define IRQ_SECTION()
+
+#endif
+
+#endif
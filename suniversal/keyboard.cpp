@@ -23,10 +23,20 @@
 
 #include "config.h"
 #include "keyboard.h"
-#include "sun_to_usb.h"
+#include "pipeline.h"
+#include "sun_codes.h"
+#include "keymap.h"
+#include "layouts.h"
 #include "macros.h"
+#include "tap_hold.h"
+#include "combos.h"
+#include "leader.h"
+#include "recorder.h"
+#include "mouse.h"
+#include "power.h"
+#include "usb_consumer.h"
 
-MacroTable macros;
+MacroPlayer macroPlayer;
 
 /*
     key report
@@ -129,7 +139,7 @@ bool KeyReport::removeKey(uint8_t k) {
 /*
     Clear all keys and reset modifier bits.
  */
-KeyReport::releaseAll() {
+void KeyReport::releaseAll() {
     memset(data.keys, 0, sizeof(data.keys));
     data.modifiers = 0;
 }
@@ -137,81 +147,768 @@ KeyReport::releaseAll() {
 /*
 
  */
-KeyReport::send() {
+void KeyReport::send() {
     usbKeyboard.send();
     DPRINT("KeyReport.send: modifiers=" +
         String(data.modifiers, HEX) + ", keys=[");
-    if (DEBUG) {
-        for (uint8_t i = 0; i < array_len(data.keys); i++) {
-            DPRINT(" " + String(data.keys[i], HEX));
-        }
+#if DEBUG == true
+    for (uint8_t i = 0; i < array_len(data.keys); i++) {
+        DPRINT(" " + String(data.keys[i], HEX));
     }
+#endif
     DPRINTLN(" ]");
 }
 
 /*
-    converter
+    keyboard pipeline stages, see pipeline.h
  */
-KeyboardConverter::KeyboardConverter() {}
 
-KeyboardConverter::setLayout(uint8_t layout) {
-    macros.adjustToLayout(layout);
-}
+// implemented in suniversal.ino
+void resetKeyboard();
+void toggleLEDs(uint8_t mask);
+uint8_t getLEDs();
 
 /*
-    If pressed, add the specified key to the key report and send the report.
-    Because of the way USB HID works, the host acts as if the key remains pressed
-    until we clear the report and resend.
+    In debug mode, the power key resets the keyboard, so it's easier to
+    observe start up messages.
+ */
+template <class Next>
+struct ResetStage : KeyStage<Next> {
+    static void handleKey(uint8_t key, bool pressed) {
+        if (key == POWER && pressed) {
+            resetKeyboard();
+            return;
+        }
+        Next::handleKey(key, pressed);
+    }
+};
 
-    If not pressed, take the specified key out of the key report and send the
-    report. This tells the OS the key is no longer pressed and that it shouldn't
-    be repeated any more.
+/*
+    Power key wakes up the host, and is then passed on as a normal key.
+
+    With USE_SUSPEND, any key wakes up the host while it's suspended. That
+    key is dropped, and so is its release later on, which `dropped` keeps
+    track of.
  */
-KeyboardConverter::handleKey(uint8_t sunKey, bool pressed) {
-    uint16_t usbKey = sun2usb[sunKey];
-    DPRINTLN("KeyboardConverter.handleKey: " +
-        String(sunKey, HEX) + " --> " + String(usbKey, HEX));
-    if (usbKey > 0) {
-        if (USE_MACROS && handleMacro(usbKey, pressed)) {
+template <class Next>
+struct WakeupStage : KeyStage<Next> {
+
+    static uint8_t dropped[16];
+
+    static void handleKey(uint8_t key, bool pressed) {
+#if USE_SUSPEND == true
+        uint8_t& b = dropped[key >> 3];
+        uint8_t bit = 1 << (key & 0x07);
+        if (power.isSuspended()) {
+            if (pressed) {
+                b |= bit;
+                power.wakeup();
+            }
             return;
         }
-        // modifiers are in high byte, non-modifiers in low byte
-        if (keyReport.handleModifier(usbKey >> 8, pressed) ||
-            keyReport.handleKey(0xFF & usbKey, pressed)) {
-            keyReport.send();
+        if (b & bit) {
+            b &= ~bit;
+            if (!pressed) {
+                return;
+            }
+        }
+#else
+        if (key == POWER && pressed) {
+            usbKeyboard.wakeupHost();
         }
+#endif
+        Next::handleKey(key, pressed);
     }
-}
+};
+
+template <class Next> uint8_t WakeupStage<Next>::dropped[16] = {0};
 
 /*
+    Records key events for the recorder, and plays back recordings. Played
+    events go through the rest of the pipeline just like typed ones, as
+    fast as the host picks up reports, or at the recorded tempo.
+ */
+template <class Next>
+struct RecorderStage : KeyStage<Next> {
+
+    static void handleKey(uint8_t key, bool pressed) {
+        recorder.record(key, pressed);
+        Next::handleKey(key, pressed);
+    }
 
+    static void tick() {
+        uint8_t key;
+        bool pressed;
+        if (recorder.playing() && usbKeyboard.ready() &&
+            recorder.next(key, pressed)) {
+            Next::handleKey(key, pressed);
+        }
+        Next::tick();
+    }
+
+    static bool busy() {
+        return recorder.playing() || Next::busy();
+    }
+};
+
+/*
+    Combos, see combos.h. Keys held back while they could still become a
+    combo are kept in order in `keys`. Once a combo has fired, `active` is
+    its table index + 1, and `down` has a bit for each of its keys that are
+    still down.
  */
-bool KeyboardConverter::handleMacro(uint16_t k, bool pressed) {
+template <class Next>
+struct ComboStage : KeyStage<Next> {
+
+    static uint8_t keys[COMBO_MAX_KEYS];
+    static uint8_t count;
+    static unsigned long firstAt;
+    static uint8_t active;
+    static uint8_t down;
+    static bool sent;
+
+    static bool isComboKey(uint8_t key) {
+        return pgm_read_byte(&comboKeys[key >> 3]) & (1 << (key & 0x07));
+    }
+
+    // position of key in combo ix, or -1
+    static int8_t position(uint8_t ix, uint8_t key) {
+        for (uint8_t j = 0; j < COMBO_MAX_KEYS; j++) {
+            if (pgm_read_byte(&combos[ix].keys[j]) == key) {
+                return j;
+            }
+        }
+        return -1;
+    }
+
+    /*
+        Looks for a combo made up of the held back keys. Returns its index
+        + 1, or the negated index + 1 of a combo that still needs more keys,
+        or 0 if there's none.
+     */
+    static int8_t match() {
+        int8_t partial = 0;
+        for (uint8_t i = 0; i < array_len(combos); i++) {
+            uint8_t k = 0;
+            while (k < count && position(i, keys[k]) >= 0) {
+                k++;
+            }
+            if (k < count) {
+                continue;
+            }
+            if (count == COMBO_MAX_KEYS ||
+                pgm_read_byte(&combos[i].keys[count]) == 0) {
+                return i + 1;
+            }
+            if (partial == 0) {
+                partial = -(i + 1);
+            }
+        }
+        return partial;
+    }
 
-    DPRINT("KeyboardConverter.handleMacro: " +
-        String(k, HEX) + ", " + String(pressed));
-    if ((k & 0xFF00) != 0xFF00) {
-        DPRINTLN(" --> not a macro");
+    static void handleKey(uint8_t key, bool pressed) {
+
+        if (active != 0 && !pressed) {
+            int8_t j = position(active - 1, key);
+            if (j >= 0 && (down & (1 << j))) {
+                if (sent) {
+                    sent = false;
+                    Next::handleCode(
+                        pgm_read_word(&combos[active - 1].code), false);
+                }
+                down &= ~(1 << j);
+                if (down == 0) {
+                    active = 0;
+                }
+                return;
+            }
+        }
+
+        if (count == 0) {
+            if (pressed && isComboKey(key)) {
+                keys[count++] = key;
+                firstAt = millis();
+            } else {
+                Next::handleKey(key, pressed);
+            }
+            return;
+        }
+
+        if (!pressed) {
+            flush();
+            Next::handleKey(key, pressed);
+            return;
+        }
+
+        keys[count++] = key;
+        int8_t m = match();
+        if (m > 0) {
+            fire(m - 1);
+        } else if (m == 0) {
+            // doesn't fit, pass on what we have and start over with this key
+            count--;
+            flush();
+            handleKey(key, pressed);
+        }
+    }
+
+    static void tick() {
+        if (count > 0 && millis() - firstAt >= COMBO_TERM) {
+            flush();
+        }
+        Next::tick();
+    }
+
+    static bool busy() {
+        return count > 0 || Next::busy();
+    }
+
+    static void fire(uint8_t ix) {
+        DPRINTLN("ComboStage.fire: " + String(ix));
+        down = 0;
+        for (uint8_t j = 0; j < count; j++) {
+            down |= 1 << position(ix, keys[j]);
+        }
+        count = 0;
+        active = ix + 1;
+        sent = true;
+        Next::handleCode(pgm_read_word(&combos[ix].code), true);
+    }
+
+    static void flush() {
+        for (uint8_t i = 0; i < count; i++) {
+            Next::handleKey(keys[i], true);
+        }
+        count = 0;
+    }
+
+    static void reset() {
+        count = 0;
+        active = 0;
+        down = 0;
+        sent = false;
+        Next::reset();
+    }
+};
+
+template <class Next> uint8_t ComboStage<Next>::keys[COMBO_MAX_KEYS];
+template <class Next> uint8_t ComboStage<Next>::count = 0;
+template <class Next> unsigned long ComboStage<Next>::firstAt = 0;
+template <class Next> uint8_t ComboStage<Next>::active = 0;
+template <class Next> uint8_t ComboStage<Next>::down = 0;
+template <class Next> bool ComboStage<Next>::sent = false;
+
+/*
+    Dual role keys, see tap_hold.h. While a dual role key is undecided, all
+    key events get buffered, with the break bit set for releases, and are
+    fed through this stage again once the decision has been made. That way,
+    another dual role key in the buffer gets its turn.
+ */
+template <class Next>
+struct TapHoldStage : KeyStage<Next> {
+
+    static uint8_t pending; // table index + 1 of undecided key, 0 if none
+    static uint8_t holding; // bit mask of table entries resolved as hold
+    static unsigned long pressedAt;
+    static uint8_t buffer[TAP_HOLD_BUFFER];
+    static uint8_t buffered;
+
+    static int8_t find(uint8_t key) {
+        for (uint8_t i = 0; i < array_len(tapHoldKeys); i++) {
+            if (pgm_read_byte(&tapHoldKeys[i].key) == key) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    static void handleKey(uint8_t key, bool pressed) {
+
+        if (pending == 0) {
+            int8_t ix = find(key);
+            if (ix < 0) {
+                Next::handleKey(key, pressed);
+            } else if (pressed) {
+                pending = ix + 1;
+                pressedAt = millis();
+            } else if (holding & (1 << ix)) {
+                holding &= ~(1 << ix);
+                Next::handleCode(
+                    pgm_read_word(&tapHoldKeys[ix].hold), false);
+            }
+            return;
+        }
+
+        if (!pressed && key == pgm_read_byte(&tapHoldKeys[pending - 1].key)) {
+            resolve(false);
+            return;
+        }
+
+        bool nested = !pressed && PERMISSIVE_HOLD && isBuffered(key);
+        buffer[buffered++] = pressed ? key : key | BREAK_BIT;
+        if (nested || buffered == TAP_HOLD_BUFFER) {
+            resolve(true);
+        }
+    }
+
+    static void tick() {
+        if (pending != 0 && millis() - pressedAt >= TAPPING_TERM) {
+            resolve(true);
+        }
+        Next::tick();
+    }
+
+    static bool busy() {
+        return pending != 0 || Next::busy();
+    }
+
+    // a lost break would otherwise get the key resolved as hold later on
+    static void reset() {
+        pending = 0;
+        holding = 0;
+        buffered = 0;
+        Next::reset();
+    }
+
+    static bool isBuffered(uint8_t key) {
+        for (uint8_t i = 0; i < buffered; i++) {
+            if (buffer[i] == key) {
+                return true;
+            }
+        }
         return false;
     }
-    DPRINTLN();
 
-    uint16_t* macro = macros.get(0xFF & k);
-    for (uint8_t i = 0; macro[i] > 0; i++) {
-        uint16_t m = macro[i];
-        if (keyReport.handleModifier(m >> 8, pressed) ||
-            keyReport.handleKey(0xFF & m, pressed)) {
-            keyReport.send();
+    /*
+        Pass on the pending key as tap or hold, followed by the buffered
+        keys. A tap gets released right after those.
+     */
+    static void resolve(bool hold) {
+
+        uint8_t ix = pending - 1;
+        pending = 0;
+
+        uint16_t elapsed = millis() - pressedAt;
+        tapHoldLatency.last = elapsed;
+        if (elapsed > tapHoldLatency.max) {
+            tapHoldLatency.max = elapsed;
+        }
+        tapHoldLatency.decisions++;
+        DPRINTLN("TapHoldStage.resolve: " + String(ix) +
+            (hold ? " held" : " tapped") + " after " + String(elapsed) + "ms");
+
+        if (hold) {
+            holding |= 1 << ix;
+            Next::handleCode(pgm_read_word(&tapHoldKeys[ix].hold), true);
+        } else {
+            tap(ix, true);
+        }
+
+        uint8_t replay[TAP_HOLD_BUFFER];
+        uint8_t count = buffered;
+        memcpy(replay, buffer, count);
+        buffered = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            handleKey(replay[i] & ~BREAK_BIT, (replay[i] & BREAK_BIT) == 0);
+        }
+
+        if (!hold) {
+            tap(ix, false);
         }
     }
 
-    return true;
+    static void tap(uint8_t ix, bool pressed) {
+        uint16_t code = pgm_read_word(&tapHoldKeys[ix].tap);
+        if (code == 0) {
+            Next::handleKey(pgm_read_byte(&tapHoldKeys[ix].key), pressed);
+        } else {
+            Next::handleCode(code, pressed);
+        }
+    }
+};
+
+template <class Next> uint8_t TapHoldStage<Next>::pending = 0;
+template <class Next> uint8_t TapHoldStage<Next>::holding = 0;
+template <class Next> unsigned long TapHoldStage<Next>::pressedAt = 0;
+template <class Next> uint8_t TapHoldStage<Next>::buffer[TAP_HOLD_BUFFER];
+template <class Next> uint8_t TapHoldStage<Next>::buffered = 0;
+
+static_assert(array_len(tapHoldKeys) <= 8, "at most 8 dual role keys");
+
+TapHoldLatency tapHoldLatency;
+
+/*
+    Compose LED turns on when the key is pressed, and goes off after the
+    next two key strokes, or when Compose is pressed again.
+ */
+template <class Next>
+struct ComposeStage : KeyStage<Next> {
+
+    static uint8_t countToOff;
+
+    static void handleKey(uint8_t key, bool pressed) {
+        if (key == COMPOSE && pressed) {
+            toggleLEDs(COMPOSE_MASK);
+            countToOff = (getLEDs() & COMPOSE_MASK) == 0 ? 0 : 3;
+        }
+        // check on every key release whether Compose needs to be switched off
+        if (!pressed && countToOff > 0) {
+            if (--countToOff == 0) {
+                toggleLEDs(COMPOSE_MASK);
+            }
+        }
+        Next::handleKey(key, pressed);
+    }
+};
+
+template <class Next> uint8_t ComposeStage<Next>::countToOff = 0;
+
+/*
+    Translates SUN scan codes into USB codes. Keys without a translation are
+    dropped here.
+ */
+template <class Next>
+struct TranslateStage : KeyStage<Next> {
+    static void handleKey(uint8_t sunKey, bool pressed) {
+        uint16_t usbKey = keymap.get(sunKey, pressed);
+        DPRINTLN("KeyboardConverter.handleKey: " +
+            String(sunKey, HEX) + " --> " + String(usbKey, HEX));
+        if (usbKey > 0) {
+            Next::handleCode(usbKey, pressed);
+        }
+    }
+};
+
+/*
+    Turns layers on and off with layer keys, see layers.h.
+ */
+template <class Next>
+struct LayerStage : KeyStage<Next> {
+    static void handleCode(uint16_t code, bool pressed) {
+        if ((code >> 8) != 0xFE) {
+            Next::handleCode(code, pressed);
+        } else if ((code & 0x80) == 0) {
+            keymap.setLayer(code & 0xFF, pressed);
+        } else if (pressed) {
+            keymap.toggleLayer(code & 0x7F);
+        }
+    }
+};
+
+/*
+    Recorder keys, see sun_to_usb.h.
+ */
+template <class Next>
+struct RecorderKeysStage : KeyStage<Next> {
+    static void handleCode(uint16_t code, bool pressed) {
+        if ((code >> 8) != 0xFC) {
+            Next::handleCode(code, pressed);
+        } else if (pressed && (code & 0x80)) {
+            recorder.play(code & 0x7F);
+        } else if (pressed) {
+            recorder.toggle(code & 0x7F);
+        }
+    }
+};
+
+/*
+    Mouse keys, see mouse_keys.h.
+ */
+template <class Next>
+struct MouseKeysStage : KeyStage<Next> {
+    static void handleCode(uint16_t code, bool pressed) {
+        if ((code >> 8) == 0xFB) {
+            mouseConverter.handleMouseKey(code & 0xFF, pressed);
+        } else {
+            Next::handleCode(code, pressed);
+        }
+    }
+};
+
+/*
+    Leader key sequences, see leader.h. While in leader mode, the node in
+    the trie is the first matching sequence `lo`, with `depth` keys typed.
+    Keys taken for a sequence are remembered in `taken`, so their releases
+    don't go on either.
+ */
+template <class Next>
+struct LeaderStage : KeyStage<Next> {
+
+    static bool active;
+    static uint8_t lo;
+    static uint8_t depth;
+    static unsigned long lastAt;
+    static uint8_t taken[16];
+
+    static void handleCode(uint16_t code, bool pressed) {
+
+        if (code == LEADER_CODE) {
+            if (pressed) {
+                DPRINTLN("LeaderStage: start");
+                active = true;
+                lo = 0;
+                depth = 0;
+                lastAt = millis();
+            }
+            return;
+        }
+
+        // releases pass, unless their key was taken for a sequence
+        if (!pressed) {
+            if (code < 0x80 && isTaken(code)) {
+                setTaken(code, false);
+            } else {
+                Next::handleCode(code, pressed);
+            }
+            return;
+        }
+
+        // so do modifiers, i.e. no key and below the special codes, see
+        // sun_to_usb.h
+        if (!active || ((code & 0xFF) == 0 && (code >> 8) < 0xF9)) {
+            Next::handleCode(code, pressed);
+            return;
+        }
+
+        // sequences are plain keys, anything else ends leader mode
+        if (code >= 0x80) {
+            DPRINTLN("LeaderStage: not a sequence key");
+            active = false;
+            Next::handleCode(code, pressed);
+            return;
+        }
+
+        uint8_t key = code;
+        setTaken(key, true);
+        uint8_t column = pgm_read_byte(&LeaderColumns::data[key]);
+        uint8_t next = column == 0 ? LEADER_NONE : pgm_read_byte(
+            &LeaderTransitions::data[(lo * LEADER_MAX_KEYS + depth) *
+                leaderKeys + column - 1]);
+        depth++;
+        lastAt = millis();
+
+        if (next == LEADER_NONE) {
+            DPRINTLN("LeaderStage: no match");
+            active = false;
+            return;
+        }
+        lo = next & ~LEADER_UNIQUE;
+        if ((next & LEADER_UNIQUE) && complete()) {
+            run();
+        }
+    }
+
+    static void tick() {
+        if (active && millis() - lastAt >= LEADER_TIMEOUT) {
+            if (depth > 0 && complete()) {
+                run();
+            } else {
+                DPRINTLN("LeaderStage: timeout");
+                active = false;
+            }
+        }
+        Next::tick();
+    }
+
+    static bool busy() {
+        return active || Next::busy();
+    }
+
+    static void reset() {
+        active = false;
+        memset(taken, 0, sizeof(taken));
+        Next::reset();
+    }
+
+    static bool isTaken(uint8_t key) {
+        return taken[key >> 3] & (1 << (key & 0x07));
+    }
+
+    static void setTaken(uint8_t key, bool on) {
+        if (on) {
+            taken[key >> 3] |= 1 << (key & 0x07);
+        } else {
+            taken[key >> 3] &= ~(1 << (key & 0x07));
+        }
+    }
+
+    // whether the node's first sequence ends after `depth` keys; since
+    // unused keys are 0, a complete sequence sorts before longer ones
+    static bool complete() {
+        return depth == LEADER_MAX_KEYS ||
+            pgm_read_byte(&leaderSequences[lo].keys[depth]) == 0;
+    }
+
+    static void run() {
+        DPRINTLN("LeaderStage: run " + String(lo));
+        active = false;
+        macroPlayer.start(
+            (const uint8_t*)pgm_read_ptr(&leaderSequences[lo].macro),
+            LEADER_MACRO_ID);
+        macroPlayer.stop(LEADER_MACRO_ID);
+    }
+};
+
+template <class Next> bool LeaderStage<Next>::active = false;
+template <class Next> uint8_t LeaderStage<Next>::lo = 0;
+template <class Next> uint8_t LeaderStage<Next>::depth = 0;
+template <class Next> unsigned long LeaderStage<Next>::lastAt = 0;
+template <class Next> uint8_t LeaderStage<Next>::taken[16];
+
+#if USE_LEADER == true && USE_MACROS != true
+#error "USE_LEADER needs USE_MACROS"
+#endif
+
+#if USE_MOUSE_KEYS == true && USE_LAYERS != true
+#error "USE_MOUSE_KEYS needs USE_LAYERS"
+#endif
+
+/*
+    Plays macros. Macro key presses and releases start and stop the macro
+    player, while the player's output is fed into the next stage from tick(),
+    at most one report change whenever the host has picked up the last one.
+ */
+template <class Next>
+struct MacroStage : KeyStage<Next> {
+
+    static void handleCode(uint16_t k, bool pressed) {
+
+        DPRINT("KeyboardConverter.handleMacro: " +
+            String(k, HEX) + ", " + String(pressed));
+        if ((k & 0xFF00) != 0xFF00) {
+            DPRINTLN(" --> not a macro");
+            Next::handleCode(k, pressed);
+            return;
+        }
+        DPRINTLN();
+
+        uint8_t ix = 0xFF & k;
+        if (ix >= END_OF_MACROS) {
+            // user keymaps are checked for this, so just in case
+            return;
+        }
+        if (pressed) {
+            macroPlayer.start(hostLayout.macro(ix), ix);
+        } else {
+            macroPlayer.stop(ix);
+        }
+    }
+
+    static void tick() {
+        uint16_t code;
+        bool pressed;
+        if (macroPlayer.busy() && usbKeyboard.ready() &&
+            macroPlayer.next(code, pressed)) {
+            Next::handleCode(code, pressed);
+        }
+        Next::tick();
+    }
+
+    static bool busy() {
+        return macroPlayer.busy() || Next::busy();
+    }
+};
+
+/*
+    End of the pipeline, puts codes into the key report.
+ */
+struct KeyReportStage {
+    static inline void handleCode(uint16_t code, bool pressed) {
+        keyboardConverter.handleCode(code, pressed);
+    }
+    static inline void tick() {}
+    static inline void reset() {}
+    static inline bool busy() {
+        return false;
+    }
+};
+
+typedef
+    Use<DEBUG, ResetStage,
+    Use<!DEBUG || USE_SUSPEND, WakeupStage,
+    Use<USE_RECORDER, RecorderStage,
+    Use<USE_COMBOS, ComboStage,
+    Use<USE_TAP_HOLD, TapHoldStage,
+    Use<COMPOSE_MODE, ComposeStage,
+    TranslateStage<
+    Use<USE_LAYERS, LayerStage,
+    Use<USE_RECORDER, RecorderKeysStage,
+    Use<USE_MOUSE_KEYS, MouseKeysStage,
+    Use<USE_LEADER, LeaderStage,
+    Use<USE_MACROS, MacroStage,
+    KeyReportStage> > > > > > > > > > > > KeyPipeline;
+
+/*
+    converter
+ */
+KeyboardConverter::KeyboardConverter() {}
+
+void KeyboardConverter::setLayout(uint8_t layout) {
+    hostLayout.select(layout);
+}
+
+/*
+    Feed SUN scan code into the pipeline.
+ */
+void KeyboardConverter::handleKey(uint8_t sunKey, bool pressed) {
+    KeyPipeline::handleKey(sunKey, pressed);
+}
+
+/*
+    If pressed, add the specified code to the key report and send the report.
+    Because of the way USB HID works, the host acts as if the key remains pressed
+    until we clear the report and resend.
+
+    If not pressed, take the specified code out of the key report and send the
+    report. This tells the OS the key is no longer pressed and that it shouldn't
+    be repeated any more.
+ */
+void KeyboardConverter::handleCode(uint16_t usbKey, bool pressed) {
+#if USE_MEDIA_KEYS == true
+    // 0xFA is CONSUMER_CONTROL, 0xF9 SYSTEM_CONTROL, see sun_to_usb.h
+    uint8_t report = 0xFA - (usbKey >> 8);
+    if (report <= SYSTEM_CONTROL) {
+        usbConsumer.handleUsage(report, usbKey & 0xFF, pressed);
+        return;
+    }
+#endif
+    // modifiers are in high byte, non-modifiers in low byte
+    if (keyReport.handleModifier(usbKey >> 8, pressed) |
+        keyReport.handleKey(0xFF & usbKey, pressed)) {
+        keyReport.send();
+    }
+}
+
+/*
+    Give pipeline stages a chance to do things over time.
+ */
+void KeyboardConverter::tick() {
+    KeyPipeline::tick();
+}
+
+/*
+    Whether the next tick has anything to do.
+ */
+bool KeyboardConverter::busy() {
+    return KeyPipeline::busy();
 }
 
 /*
-    Clear report and send it.
+    Reset pipeline stages, clear report and send it.
  */
-KeyboardConverter::releaseAll() {
+void KeyboardConverter::releaseAll() {
+    KeyPipeline::reset();
+    keymap.releaseAll();
+#if USE_RECORDER == true
+    recorder.releaseAll();
+#endif
+#if USE_MOUSE_KEYS == true
+    mouseConverter.releaseMouseKeys();
+#endif
+#if USE_MEDIA_KEYS == true
+    usbConsumer.releaseAll();
+#endif
     keyReport.releaseAll();
     keyReport.send();
 }
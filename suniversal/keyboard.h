@@ -40,8 +40,8 @@ public:
     KeyReport();
     bool handleModifier(uint8_t k, bool pressed);
     bool handleKey(uint8_t k, bool pressed);
-    releaseAll();
-    send();
+    void releaseAll();
+    void send();
 };
 
 /*
@@ -51,13 +51,15 @@ class KeyboardConverter {
 
 private:
     KeyReport keyReport;
-    bool handleMacro(uint16_t k, bool pressed);
 
 public:
     KeyboardConverter();
-    setLayout(uint8_t layout);
-    handleKey(uint8_t k, bool pressed);
-    releaseAll();
+    void setLayout(uint8_t layout);
+    void handleKey(uint8_t k, bool pressed);
+    void handleCode(uint16_t code, bool pressed);
+    void tick();
+    bool busy();
+    void releaseAll();
 };
 
 extern KeyboardConverter keyboardConverter;
@@ -0,0 +1,313 @@
+/*
+    keymap - SUN to USB translation, with user overrides from EEPROM
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+#include "config.h"
+#include "keymap.h"
+#include "recorder.h"
+#include "usb_keyboard.h"
+
+// EEPROM slot layout: sequence number, followed by the report as uploaded
+#define SLOT_SIZE (1 + sizeof(KeymapReport))
+#define SLOT_ADDRESS(s) (KEYMAP_EEPROM_START + (s) * SLOT_SIZE)
+
+/*
+    Layer tables, each one a complete keymap generated by the compiler from
+    the base keymap and the keys listed for the layer in layers.h.
+ */
+#if USE_LAYERS == true
+
+constexpr uint16_t layerKeyCode(const LayerKey* layer, uint8_t n,
+    uint8_t key, uint8_t i = 0) {
+    return i == n ? sun2usb[key] :
+        layer[i].key == key ? layer[i].code :
+        layerKeyCode(layer, n, key, i + 1);
+}
+
+#define LAYER_4(L, k) \
+    layerKeyCode(L, array_len(L), (k)), \
+    layerKeyCode(L, array_len(L), (k) + 1), \
+    layerKeyCode(L, array_len(L), (k) + 2), \
+    layerKeyCode(L, array_len(L), (k) + 3)
+#define LAYER_32(L, k) \
+    LAYER_4(L, (k)), LAYER_4(L, (k) + 4), LAYER_4(L, (k) + 8), \
+    LAYER_4(L, (k) + 12), LAYER_4(L, (k) + 16), LAYER_4(L, (k) + 20), \
+    LAYER_4(L, (k) + 24), LAYER_4(L, (k) + 28)
+#define LAYER_TABLE(L) { \
+    LAYER_32(L, 0x00), LAYER_32(L, 0x20), \
+    LAYER_32(L, 0x40), LAYER_32(L, 0x60) }
+
+static constexpr uint16_t layer_1_table[128] PROGMEM = LAYER_TABLE(layer_1);
+
+static_assert(layer_1_table[0x05] == USB_F13, "F1 on layer 1 should be F13");
+static_assert(layer_1_table[0x36] == USB_Q, "Q should show through layer 1");
+
+#if USE_MOUSE_KEYS == true
+static constexpr uint16_t layer_2_table[128] PROGMEM = LAYER_TABLE(layer_2);
+#endif
+
+// indexed by layer number - 1
+static const uint16_t* const layerTables[] PROGMEM = {
+    layer_1_table,
+#if USE_MOUSE_KEYS == true
+    layer_2_table,
+#endif
+};
+
+static_assert(array_len(layerTables) <= MAX_LAYERS, "too many layers");
+
+#endif
+
+Keymap::Keymap() {
+#if USE_LAYERS == true
+    locked = 0;
+    releaseAll();
+    memset(keyLayers, 0, sizeof(keyLayers));
+#endif
+}
+
+#if USE_USER_KEYMAP == true
+
+/*
+    Load the most recent valid keymap from EEPROM, and start accepting
+    uploads.
+ */
+void Keymap::begin() {
+    uint8_t seq0 = EEPROM.read(SLOT_ADDRESS(0));
+    uint8_t seq1 = EEPROM.read(SLOT_ADDRESS(1));
+    slot = (int8_t)(seq1 - seq0) > 0 ? 1 : 0;
+
+    if (!load(slot)) {
+        slot ^= 1;
+        if (!load(slot)) {
+            DPRINTLN("Keymap.begin: no user keymap");
+            report.count = 0;
+        }
+    }
+    apply();
+
+    usbKeyboard.setFeatureReport(&report, sizeof(report));
+    usbKeyboard.enableFeatureReport();
+}
+
+/*
+    Call from main loop. When the host has uploaded a keymap, this validates,
+    stores, and applies it. Returns true if the keymap has changed, in which
+    case any keys still held should be released, since they may now map to
+    something else.
+ */
+bool Keymap::update() {
+
+    if (usbKeyboard.availableFeatureReport() == 0) {
+        return false;
+    }
+
+    bool changed = valid();
+    if (changed) {
+        DPRINTLN("Keymap.update: storing " + String(report.count) +
+            " overrides");
+        store();
+        apply();
+    } else {
+        DPRINTLN("Keymap.update: invalid keymap");
+    }
+
+    usbKeyboard.enableFeatureReport();
+    return changed;
+}
+
+/*
+    Whether code is something the pipeline can handle, see sun_to_usb.h.
+    Codes for features that are off, and indexes out of range, e.g. a macro
+    past the end of the macro tables, are not. Anything below the special
+    codes is a key with modifiers.
+ */
+static bool validCode(uint16_t code) {
+    uint8_t n = code & 0xFF;
+    switch (code >> 8) {
+#if USE_MACROS == true
+        case 0xFF:
+            return n < END_OF_MACROS;
+#endif
+#if USE_LAYERS == true
+        case 0xFE:
+            n &= 0x7F; // toggle bit
+            return n > 0 && n <= array_len(layerTables);
+#endif
+#if USE_LEADER == true
+        case 0xFD:
+            return code == LEADER_CODE;
+#endif
+#if USE_RECORDER == true
+        case 0xFC:
+            return (n & 0x7F) < RECORDER_SLOTS; // play bit
+#endif
+#if USE_MOUSE_KEYS == true
+        case 0xFB:
+            return true;
+#endif
+#if USE_MEDIA_KEYS == true
+        case 0xFA:
+        case 0xF9:
+            return true;
+#endif
+    }
+    return (code >> 8) < 0xF9;
+}
+
+/*
+    Check CRC and content of report.
+ */
+bool Keymap::valid() {
+
+    const uint8_t* p = (const uint8_t*)&report;
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < offsetof(KeymapReport, crc); i++) {
+        crc = _crc8_ccitt_update(crc, p[i]);
+    }
+
+    if (crc != report.crc || report.count > KEYMAP_MAX_OVERRIDES) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < report.count; i++) {
+        if (report.overrides[i].key >= array_len(codes) ||
+            !validCode(report.overrides[i].code)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    Read keymap from EEPROM slot s into report.
+ */
+bool Keymap::load(uint8_t s) {
+    EEPROM.get(SLOT_ADDRESS(s) + 1, report);
+    return valid();
+}
+
+/*
+    Write report into the slot not in use, then make it the current one by
+    bumping its sequence number.
+ */
+void Keymap::store() {
+    uint8_t seq = EEPROM.read(SLOT_ADDRESS(slot)) + 1;
+    slot ^= 1;
+    EEPROM.put(SLOT_ADDRESS(slot) + 1, report);
+    EEPROM.update(SLOT_ADDRESS(slot), seq);
+}
+
+/*
+    Rebuild RAM keymap from sun2usb and overrides in report.
+ */
+void Keymap::apply() {
+    memcpy_P(codes, sun2usb, sizeof(codes));
+    for (uint8_t i = 0; i < report.count; i++) {
+        codes[report.overrides[i].key] = report.overrides[i].code;
+    }
+}
+
+#else
+
+void Keymap::begin() {}
+
+bool Keymap::update() {
+    return false;
+}
+
+#endif
+
+#if USE_LAYERS == true
+
+/*
+    Turn layer n on or off. A layer that's toggled on stays on.
+ */
+void Keymap::setLayer(uint8_t n, bool on) {
+
+    if (n == 0 || n > array_len(layerTables)) {
+        return;
+    }
+
+    if (on) {
+        layers |= 1 << n;
+    } else {
+        layers &= ~(1 << n);
+    }
+    layers |= locked;
+    top = layers & 0x08 ? 3 : layers & 0x04 ? 2 : layers & 0x02 ? 1 : 0;
+    DPRINTLN("Keymap.setLayer: " + String(n) + ", top layer is " +
+        String(top));
+}
+
+/*
+    Toggle layer n on or off.
+ */
+void Keymap::toggleLayer(uint8_t n) {
+    if (n == 0 || n > array_len(layerTables)) {
+        return;
+    }
+    locked ^= 1 << n;
+    setLayer(n, locked & (1 << n));
+}
+
+/*
+    Turn off all layers except those toggled on, for when all keys have
+    been released.
+ */
+void Keymap::releaseAll() {
+    layers = locked;
+    top = layers & 0x08 ? 3 : layers & 0x04 ? 2 : layers & 0x02 ? 1 : 0;
+}
+
+/*
+    When key is pressed, remember the layer that's on top, otherwise get the
+    layer that was on top when it was pressed.
+ */
+uint8_t Keymap::keyLayer(uint8_t key, bool pressed) {
+    uint8_t& b = keyLayers[key >> 2];
+    uint8_t shift = (key & 0x03) << 1;
+    if (pressed) {
+        b = (b & ~(0x03 << shift)) | (top << shift);
+        return top;
+    }
+    return (b >> shift) & 0x03;
+}
+
+uint16_t Keymap::layerCode(uint8_t layer, uint8_t key) {
+    const uint16_t* table =
+        (const uint16_t*)pgm_read_ptr(&layerTables[layer - 1]);
+    return pgm_read_word(&table[key]);
+}
+
+#else
+
+void Keymap::setLayer(uint8_t n, bool on) {}
+
+void Keymap::toggleLayer(uint8_t n) {}
+
+void Keymap::releaseAll() {}
+
+#endif
+
+Keymap keymap;
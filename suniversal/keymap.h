@@ -0,0 +1,140 @@
+/*
+    keymap - SUN to USB translation, with user overrides from EEPROM
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYMAP_h
+#define KEYMAP_h
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "sun_to_usb.h"
+#include "layers.h"
+
+// max number of keys a user keymap can override
+#define KEYMAP_MAX_OVERRIDES 20
+
+// where in EEPROM the user keymap lives, takes two slots
+#define KEYMAP_EEPROM_START  0
+
+/*
+    A user keymap is a list of overrides on top of sun2usb. It gets uploaded
+    from the host as a feature report of the keyboard interface, in exactly
+    this format:
+
+     - count:     number of overrides used, 0 restores the built-in keymap
+     - overrides: SUN scan code & 16 bit code as in sun_to_usb.h (little
+                  endian), unused entries are ignored; codes for features
+                  that are off, or out of range, fail the whole upload
+     - crc:       CRC-8 (polynomial 0x07, initial value 0) over all bytes
+                  before it
+
+    The report is always sent in full, so every upload replaces the whole
+    set of overrides.
+ */
+struct KeymapOverride {
+    uint8_t key;
+    uint16_t code;
+} __attribute__((packed));
+
+struct KeymapReport {
+    uint8_t count;
+    KeymapOverride overrides[KEYMAP_MAX_OVERRIDES];
+    uint8_t crc;
+} __attribute__((packed));
+
+/*
+    The keymap in use. With USE_USER_KEYMAP, it's a RAM copy of sun2usb with
+    the user's overrides applied, built at start up and whenever a new
+    keymap has been uploaded. With USE_LAYERS, there's additionally a flash
+    table for each layer (see layers.h). Either way, looking up a key is a
+    single table access.
+
+    Uploaded keymaps are stored alternately in two EEPROM slots, each with a
+    sequence number that gets written last. So if power is lost while
+    storing, the slot being written is either incomplete and fails the CRC
+    check, or still has the older sequence number. In both cases, we come up
+    with the previous keymap.
+ */
+class Keymap {
+
+private:
+#if USE_USER_KEYMAP == true
+    uint16_t codes[128];
+    KeymapReport report; // receives uploads from host
+    uint8_t slot;
+    bool valid();
+    bool load(uint8_t s);
+    void store();
+    void apply();
+#endif
+#if USE_LAYERS == true
+    uint8_t layers;        // bit n is set while layer n is on
+    uint8_t locked;        // bit n is set while layer n is toggled on
+    uint8_t top;           // highest layer that's on
+    uint8_t keyLayers[32]; // layer each key was pressed on, 2 bits per key
+    uint8_t keyLayer(uint8_t key, bool pressed);
+    uint16_t layerCode(uint8_t layer, uint8_t key);
+#endif
+
+    inline uint16_t baseCode(uint8_t key) {
+#if USE_USER_KEYMAP == true
+        return codes[key];
+#else
+        return pgm_read_word(&sun2usb[key]);
+#endif
+    }
+
+public:
+    Keymap();
+    void begin();
+    bool update();
+    void setLayer(uint8_t n, bool on);
+    void toggleLayer(uint8_t n);
+    void releaseAll();
+
+    /*
+        Code for key, from the layer that was on when the key got pressed,
+        so a key always releases what it pressed.
+     */
+    inline uint16_t get(uint8_t key, bool pressed) {
+#if USE_LAYERS == true
+        uint8_t l = keyLayer(key, pressed);
+        if (l > 0) {
+            return layerCode(l, key);
+        }
+#endif
+        return baseCode(key);
+    }
+
+    /*
+        Layers toggled on, one bit each.
+     */
+    inline uint8_t toggled() {
+#if USE_LAYERS == true
+        return locked;
+#else
+        return 0;
+#endif
+    }
+};
+
+extern Keymap keymap;
+
+#endif
@@ -0,0 +1,119 @@
+/*
+    layers - additional keymap layers
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAYERS_h
+#define LAYERS_h
+
+#include <stdint.h>
+#include "config.h"
+#include "sun_to_usb.h"
+#include "usb_codes.h"
+#include "mouse_keys.h"
+
+/*
+    Layers sit on top of the base keymap in sun_to_usb.h, and are switched on
+    while their layer key is held. A layer key has LAYER_CODE(n) assigned in
+    sun_to_usb.h, e.g. Line_Feed for layer 1. Any key can be a layer key,
+    such as one of the keys in the fun cluster, but note that a layer key
+    shouldn't be overridden on its own layer.
+
+    If several layers are on, the one with the highest number wins. Each
+    layer only lists the keys it changes, all others are taken from the base
+    layer. The compiler turns each layer into a complete table (see
+    keymap.cpp), so looking up a key costs the same on any layer. User
+    overrides from EEPROM apply to the base layer only.
+
+    There can be up to MAX_LAYERS layers besides the base layer.
+ */
+#define MAX_LAYERS 3
+
+struct LayerKey {
+    uint8_t key;   // SUN scan code
+    uint16_t code; // as in sun_to_usb.h
+};
+
+// layer 1: F13 through F24 on the function keys, and cursor keys on H/J/K/L;
+// with USE_RECORDER, the left column of the fun cluster records, and the
+// right column plays; with USE_MEDIA_KEYS, play/pause and track keys on the
+// volume keys, and sleep on Power
+static constexpr LayerKey layer_1[] = {
+    {0x05 /* F1  */, USB_F13},
+    {0x06 /* F2  */, USB_F14},
+    {0x08 /* F3  */, USB_F15},
+    {0x0A /* F4  */, USB_F16},
+    {0x0C /* F5  */, USB_F17},
+    {0x0E /* F6  */, USB_F18},
+    {0x10 /* F7  */, USB_F19},
+    {0x11 /* F8  */, USB_F20},
+    {0x12 /* F9  */, USB_F21},
+    {0x07 /* F10 */, USB_F22},
+    {0x09 /* F11 */, USB_F23},
+    {0x0B /* F12 */, USB_F24},
+    {0x52 /* H   */, USB_LEFT},
+    {0x53 /* J   */, USB_DOWN},
+    {0x54 /* K   */, USB_UP},
+    {0x55 /* L   */, USB_RIGHT},
+    {0x2B /* Backspace */, USB_DELETE},
+    {0x60 /* PgUp */, USB_HOME},
+    {0x7B /* PgDn */, USB_END},
+#if USE_RECORDER == true
+    {0x01 /* Stop  */, REC_CODE(0)},
+    {0x03 /* Again */, PLAY_CODE(0)},
+    {0x19 /* Props */, REC_CODE(1)},
+    {0x1A /* Undo  */, PLAY_CODE(1)},
+    {0x31 /* Front */, REC_CODE(2)},
+    {0x33 /* Copy  */, PLAY_CODE(2)},
+    {0x48 /* Open  */, REC_CODE(3)},
+    {0x49 /* Paste */, PLAY_CODE(3)},
+#endif
+#if USE_MOUSE_KEYS == true
+    {0x62 /* Num_Lock */, LAYER_TOGGLE(2)},
+#endif
+#if USE_MEDIA_KEYS == true
+    {0x2D /* Mute */, CONSUMER_CODE(USB_CONSUMER_PLAYPAUSE)},
+    {0x02 /* Volume_Decr */, CONSUMER_CODE(USB_CONSUMER_PREVIOUSSONG)},
+    {0x04 /* Volume_Incr */, CONSUMER_CODE(USB_CONSUMER_NEXTSONG)},
+    {0x30 /* Power */, SYSTEM_CODE(USB_SYSTEM_SLEEP)},
+#endif
+};
+
+#if USE_MOUSE_KEYS == true
+
+// layer 2: mouse keys on the keypad, toggled with Line_Feed + Num_Lock, and
+// back off with Num_Lock; KP5 is the left, KP0 the right, and KP. the middle
+// button, which scrolls when EMULATE_SCROLL_WHEEL is on
+static constexpr LayerKey layer_2[] = {
+    {0x44 /* KP7 */, MOUSE_KEY(MK_UP | MK_LEFT)},
+    {0x45 /* KP8 */, MOUSE_KEY(MK_UP)},
+    {0x46 /* KP9 */, MOUSE_KEY(MK_UP | MK_RIGHT)},
+    {0x5B /* KP4 */, MOUSE_KEY(MK_LEFT)},
+    {0x5C /* KP5 */, MOUSE_KEY(MK_BUTTON_LEFT)},
+    {0x5D /* KP6 */, MOUSE_KEY(MK_RIGHT)},
+    {0x70 /* KP1 */, MOUSE_KEY(MK_DOWN | MK_LEFT)},
+    {0x71 /* KP2 */, MOUSE_KEY(MK_DOWN)},
+    {0x72 /* KP3 */, MOUSE_KEY(MK_DOWN | MK_RIGHT)},
+    {0x5E /* KP0 */, MOUSE_KEY(MK_BUTTON_RIGHT)},
+    {0x32 /* KP. */, MOUSE_KEY(MK_BUTTON_MIDDLE)},
+    {0x62 /* Num_Lock */, LAYER_TOGGLE(2)},
+};
+
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+/*
+    layouts - host keyboard layouts, for typing text
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "layouts.h"
+#include "macros.h"
+
+/*
+    Reverse keymaps, one code for each of the characters 0x20 through 0x7F,
+    all computed by the compiler from the layout definitions in layouts.h.
+ */
+#define RKM_4(K, c) \
+    CHAR_CODE(K, (c)), CHAR_CODE(K, (c) + 1), \
+    CHAR_CODE(K, (c) + 2), CHAR_CODE(K, (c) + 3)
+#define RKM_16(K, c) \
+    RKM_4(K, (c)), RKM_4(K, (c) + 4), RKM_4(K, (c) + 8), RKM_4(K, (c) + 12)
+#define REVERSE_KEYMAP(K) { \
+    RKM_16(K, 0x20), RKM_16(K, 0x30), RKM_16(K, 0x40), \
+    RKM_16(K, 0x50), RKM_16(K, 0x60), RKM_16(K, 0x70) }
+
+#define FIRST_CHAR 0x20
+#define LAST_CHAR  0x7E
+
+static constexpr uint16_t map_us[] PROGMEM = REVERSE_KEYMAP(keys_us);
+static constexpr uint16_t map_fr[] PROGMEM = REVERSE_KEYMAP(keys_fr);
+static constexpr uint16_t map_ca[] PROGMEM = REVERSE_KEYMAP(keys_ca);
+static constexpr uint16_t map_dk[] PROGMEM = REVERSE_KEYMAP(keys_dk);
+static constexpr uint16_t map_de[] PROGMEM = REVERSE_KEYMAP(keys_de);
+static constexpr uint16_t map_it[] PROGMEM = REVERSE_KEYMAP(keys_it);
+static constexpr uint16_t map_nl[] PROGMEM = REVERSE_KEYMAP(keys_nl);
+static constexpr uint16_t map_no[] PROGMEM = REVERSE_KEYMAP(keys_no);
+static constexpr uint16_t map_pt[] PROGMEM = REVERSE_KEYMAP(keys_pt);
+static constexpr uint16_t map_es[] PROGMEM = REVERSE_KEYMAP(keys_es);
+static constexpr uint16_t map_se[] PROGMEM = REVERSE_KEYMAP(keys_se);
+static constexpr uint16_t map_ch[] PROGMEM = REVERSE_KEYMAP(keys_ch);
+static constexpr uint16_t map_uk[] PROGMEM = REVERSE_KEYMAP(keys_uk);
+
+// sanity checks for a few well known keys
+static_assert(map_us['@' - FIRST_CHAR] == (USB_MOD_LSHIFT << 8 | USB_2),
+    "US @ should be Shift-2");
+static_assert(map_de['z' - FIRST_CHAR] == USB_Y, "German z is on Y key");
+static_assert(map_de['@' - FIRST_CHAR] == (USB_MOD_RALT << 8 | USB_Q),
+    "German @ should be AltGr-Q");
+static_assert(map_fr['a' - FIRST_CHAR] == USB_Q, "French a is on Q key");
+static_assert(map_fr['1' - FIRST_CHAR] == (USB_MOD_LSHIFT << 8 | USB_1),
+    "French 1 needs Shift");
+static_assert(map_it['{' - FIRST_CHAR] ==
+    ((USB_MOD_LSHIFT | USB_MOD_RALT) << 8 | USB_LEFTBRACE),
+    "Italian { should be Shift-AltGr-è");
+
+static const char dead_us[] PROGMEM = DEAD_US;
+static const char dead_fr[] PROGMEM = DEAD_FR;
+static const char dead_ca[] PROGMEM = DEAD_CA;
+static const char dead_dk[] PROGMEM = DEAD_DK;
+static const char dead_de[] PROGMEM = DEAD_DE;
+static const char dead_it[] PROGMEM = DEAD_IT;
+static const char dead_nl[] PROGMEM = DEAD_NL;
+static const char dead_no[] PROGMEM = DEAD_NO;
+static const char dead_pt[] PROGMEM = DEAD_PT;
+static const char dead_es[] PROGMEM = DEAD_ES;
+static const char dead_se[] PROGMEM = DEAD_SE;
+static const char dead_ch[] PROGMEM = DEAD_CH;
+static const char dead_uk[] PROGMEM = DEAD_UK;
+
+// indexed by layout code, see config.h
+static const LayoutMap layoutMaps[] PROGMEM = {
+    /* UNITED_STATES       */ {map_us, dead_us, macros_us},
+    /* (not used)          */ {map_us, dead_us, macros_us},
+    /* FRENCH_BELGIUM      */ {map_fr, dead_fr, macros_fr},
+    /* CANADA_FRENCH       */ {map_ca, dead_ca, macros_ca},
+    /* DENMARK             */ {map_dk, dead_dk, macros_dk},
+    /* GERMANY             */ {map_de, dead_de, macros_de},
+    /* ITALY               */ {map_it, dead_it, macros_it},
+    /* NETHERLANDS         */ {map_nl, dead_nl, macros_nl},
+    /* NORWAY              */ {map_no, dead_no, macros_no},
+    /* PORTUGAL            */ {map_pt, dead_pt, macros_pt},
+    /* SPAIN_LATIN_AMERICA */ {map_es, dead_es, macros_es},
+    /* SWEDEN_FINLAND      */ {map_se, dead_se, macros_se},
+    /* SWISS_FRENCH        */ {map_ch, dead_ch, macros_ch},
+    /* SWISS_GERMAN        */ {map_ch, dead_ch, macros_ch},
+    /* UNITED_KINGDOM      */ {map_uk, dead_uk, macros_uk}
+};
+
+static_assert(array_len(layoutMaps) == UNITED_KINGDOM + 1,
+    "need a map for each layout");
+
+HostLayout::HostLayout() : map(&layoutMaps[UNITED_STATES]) {}
+
+/*
+    Switch to layout, unknown layouts get US.
+ */
+void HostLayout::select(uint8_t layout) {
+    if (layout >= array_len(layoutMaps)) {
+        layout = UNITED_STATES;
+    }
+    map = &layoutMaps[layout];
+}
+
+/*
+    Returns key code for c, or 0 if c can't be typed.
+ */
+uint16_t HostLayout::charCode(char c) {
+    switch (c) {
+        case '\n':
+            return USB_ENTER;
+        case '\t':
+            return USB_TAB;
+    }
+    if (c < FIRST_CHAR || c > LAST_CHAR) {
+        return 0;
+    }
+    const uint16_t* codes = (const uint16_t*)pgm_read_ptr(&map->codes);
+    return pgm_read_word(codes + c - FIRST_CHAR);
+}
+
+/*
+    Whether c is typed with a dead key, and needs a space afterwards.
+ */
+bool HostLayout::isDead(char c) {
+    return strchr_P((const char*)pgm_read_ptr(&map->dead), c) != NULL;
+}
+
+/*
+    Returns macro program number ix, which is in flash.
+ */
+const uint8_t* HostLayout::macro(uint8_t ix) {
+    const uint8_t* const* macros =
+        (const uint8_t* const*)pgm_read_ptr(&map->macros);
+    return (const uint8_t*)pgm_read_ptr(&macros[ix]);
+}
+
+HostLayout hostLayout;
@@ -0,0 +1,305 @@
+/*
+    layouts - host keyboard layouts, for typing text
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAYOUTS_h
+#define LAYOUTS_h
+
+#include <stdint.h>
+#include "config.h"
+#include "usb_codes.h"
+
+/*
+    What a key produces on the host, on each level: plain, with Shift, with
+    AltGr, and with Shift+AltGr. Only ASCII matters here, so 0 stands for
+    anything else, as well as for dead keys that have a non-dead alternative
+    elsewhere on the layout. Levels left out in the tables are 0.
+ */
+struct KeyChars {
+    uint8_t usage;
+    char base;
+    char shift;
+    char altgr;
+    char shiftAltgr;
+
+    constexpr KeyChars(uint8_t u, char b, char s, char a, char sa) :
+        usage(u), base(b), shift(s), altgr(a), shiftAltgr(sa) {}
+    constexpr KeyChars(uint8_t u, char b, char s, char a) :
+        KeyChars(u, b, s, a, 0) {}
+    constexpr KeyChars(uint8_t u, char b, char s) : KeyChars(u, b, s, 0, 0) {}
+    constexpr KeyChars(uint8_t u, char b) : KeyChars(u, b, 0, 0, 0) {}
+};
+
+/*
+    Keys that are the same on all layouts, unless a layout overrides them.
+ */
+static constexpr KeyChars keys_common[] = {
+    {USB_A, 'a', 'A'}, {USB_B, 'b', 'B'}, {USB_C, 'c', 'C'}, {USB_D, 'd', 'D'},
+    {USB_E, 'e', 'E'}, {USB_F, 'f', 'F'}, {USB_G, 'g', 'G'}, {USB_H, 'h', 'H'},
+    {USB_I, 'i', 'I'}, {USB_J, 'j', 'J'}, {USB_K, 'k', 'K'}, {USB_L, 'l', 'L'},
+    {USB_M, 'm', 'M'}, {USB_N, 'n', 'N'}, {USB_O, 'o', 'O'}, {USB_P, 'p', 'P'},
+    {USB_Q, 'q', 'Q'}, {USB_R, 'r', 'R'}, {USB_S, 's', 'S'}, {USB_T, 't', 'T'},
+    {USB_U, 'u', 'U'}, {USB_V, 'v', 'V'}, {USB_W, 'w', 'W'}, {USB_X, 'x', 'X'},
+    {USB_Y, 'y', 'Y'}, {USB_Z, 'z', 'Z'},
+    {USB_SPACE, ' ', ' '}
+};
+
+/*
+    Per layout differences, following the default variants of the X keyboard
+    configuration. Keys are listed in the order of the physical rows. Where a
+    character can only be typed with a dead key, it's listed and also noted
+    in the layout's dead key string, so that a space gets typed after it.
+ */
+static constexpr KeyChars keys_us[] = {
+    {USB_GRAVE, '`', '~'},
+    {USB_1, '1', '!'}, {USB_2, '2', '@'}, {USB_3, '3', '#'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '^'},
+    {USB_7, '7', '&'}, {USB_8, '8', '*'}, {USB_9, '9', '('},
+    {USB_0, '0', ')'}, {USB_MINUS, '-', '_'}, {USB_EQUAL, '=', '+'},
+    {USB_LEFTBRACE, '[', '{'}, {USB_RIGHTBRACE, ']', '}'},
+    {USB_BACKSLASH, '\\', '|'},
+    {USB_SEMICOLON, ';', ':'}, {USB_APOSTROPHE, '\'', '"'},
+    {USB_COMMA, ',', '<'}, {USB_DOT, '.', '>'}, {USB_SLASH, '/', '?'}
+};
+#define DEAD_US ""
+
+static constexpr KeyChars keys_fr[] = {
+    {USB_1, '&', '1'}, {USB_2, 0, '2', '~'}, {USB_3, '"', '3', '#'},
+    {USB_4, '\'', '4', '{'}, {USB_5, '(', '5', '['}, {USB_6, '-', '6', '|'},
+    {USB_7, 0, '7', '`'}, {USB_8, '_', '8', '\\'}, {USB_9, 0, '9', '^'},
+    {USB_0, 0, '0', '@'}, {USB_MINUS, ')', 0, ']'}, {USB_EQUAL, '=', '+', '}'},
+    {USB_Q, 'a', 'A'}, {USB_W, 'z', 'Z'}, {USB_RIGHTBRACE, '$'},
+    {USB_A, 'q', 'Q'}, {USB_SEMICOLON, 'm', 'M'}, {USB_APOSTROPHE, 0, '%'},
+    {USB_BACKSLASH, '*'},
+    {USB_102ND, '<', '>'}, {USB_Z, 'w', 'W'}, {USB_M, ',', '?'},
+    {USB_COMMA, ';', '.'}, {USB_DOT, ':', '/'}, {USB_SLASH, '!'}
+};
+#define DEAD_FR ""
+
+static constexpr KeyChars keys_ca[] = {
+    {USB_GRAVE, '#', '|', '\\'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"', '@'}, {USB_3, '3', '/'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '?'},
+    {USB_7, '7', '&'}, {USB_8, '8', '*'}, {USB_9, '9', '('},
+    {USB_0, '0', ')'}, {USB_MINUS, '-', '_'}, {USB_EQUAL, '=', '+'},
+    {USB_LEFTBRACE, '^', 0, '['}, {USB_RIGHTBRACE, 0, 0, ']'},
+    {USB_SEMICOLON, ';', ':', '~'}, {USB_APOSTROPHE, '`', 0, '{'},
+    {USB_BACKSLASH, '<', '>', '}'},
+    {USB_COMMA, ',', '\''}, {USB_DOT, '.'}
+};
+#define DEAD_CA "^`"
+
+static constexpr KeyChars keys_dk[] = {
+    {USB_1, '1', '!'}, {USB_2, '2', '"', '@'}, {USB_3, '3', '#'},
+    {USB_4, '4', 0, '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/', '{'}, {USB_8, '8', '(', '['}, {USB_9, '9', ')', ']'},
+    {USB_0, '0', '=', '}'}, {USB_MINUS, '+', '?'}, {USB_EQUAL, 0, '`', '|'},
+    {USB_RIGHTBRACE, 0, '^', '~'},
+    {USB_BACKSLASH, '\'', '*'},
+    {USB_102ND, '<', '>', '\\'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_DK "`^~"
+
+static constexpr KeyChars keys_de[] = {
+    {USB_GRAVE, '^'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"'}, {USB_3, '3'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/', '{'}, {USB_8, '8', '(', '['}, {USB_9, '9', ')', ']'},
+    {USB_0, '0', '=', '}'}, {USB_MINUS, 0, '?', '\\'}, {USB_EQUAL, 0, '`'},
+    {USB_Q, 'q', 'Q', '@'}, {USB_Y, 'z', 'Z'}, {USB_RIGHTBRACE, '+', '*', '~'},
+    {USB_BACKSLASH, '#', '\''},
+    {USB_102ND, '<', '>', '|'}, {USB_Z, 'y', 'Y'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_DE "^`"
+
+static constexpr KeyChars keys_it[] = {
+    {USB_GRAVE, '\\', '|'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"'}, {USB_3, '3'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/'}, {USB_8, '8', '('}, {USB_9, '9', ')'},
+    {USB_0, '0', '='}, {USB_MINUS, '\'', '?', '`'}, {USB_EQUAL, 0, '^', '~'},
+    {USB_LEFTBRACE, 0, 0, '[', '{'}, {USB_RIGHTBRACE, '+', '*', ']', '}'},
+    {USB_SEMICOLON, 0, 0, '@'}, {USB_APOSTROPHE, 0, 0, '#'},
+    {USB_102ND, '<', '>'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_IT ""
+
+static constexpr KeyChars keys_nl[] = {
+    {USB_GRAVE, '@'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"'}, {USB_3, '3', '#'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '_'}, {USB_8, '8', '(', '{'}, {USB_9, '9', ')', '}'},
+    {USB_0, '0', '\''}, {USB_MINUS, '/', '?', '\\'}, {USB_EQUAL, 0, '~'},
+    {USB_LEFTBRACE, 0, '^'}, {USB_RIGHTBRACE, '*', '|'},
+    {USB_SEMICOLON, '+'}, {USB_APOSTROPHE, 0, '`'},
+    {USB_BACKSLASH, '<', '>'},
+    {USB_102ND, ']', '['},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '='}
+};
+#define DEAD_NL "~^`"
+
+static constexpr KeyChars keys_no[] = {
+    {USB_GRAVE, '|'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"', '@'}, {USB_3, '3', '#'},
+    {USB_4, '4', 0, '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/', '{'}, {USB_8, '8', '(', '['}, {USB_9, '9', ')', ']'},
+    {USB_0, '0', '=', '}'}, {USB_MINUS, '+', '?'}, {USB_EQUAL, '\\', '`'},
+    {USB_RIGHTBRACE, 0, '^', '~'},
+    {USB_BACKSLASH, '\'', '*'},
+    {USB_102ND, '<', '>'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_NO "`^~"
+
+static constexpr KeyChars keys_pt[] = {
+    {USB_GRAVE, '\\', '|'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"', '@'}, {USB_3, '3', '#'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/', '{'}, {USB_8, '8', '(', '['}, {USB_9, '9', ')', ']'},
+    {USB_0, '0', '=', '}'}, {USB_MINUS, '\'', '?'},
+    {USB_LEFTBRACE, '+', '*'}, {USB_RIGHTBRACE, 0, '`'},
+    {USB_BACKSLASH, '~', '^'},
+    {USB_102ND, '<', '>'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_PT "`~^"
+
+static constexpr KeyChars keys_es[] = {
+    {USB_GRAVE, 0, 0, '\\'},
+    {USB_1, '1', '!', '|'}, {USB_2, '2', '"', '@'}, {USB_3, '3', 0, '#'},
+    {USB_4, '4', '$', '~'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/'}, {USB_8, '8', '('}, {USB_9, '9', ')'},
+    {USB_0, '0', '='}, {USB_MINUS, '\'', '?'},
+    {USB_LEFTBRACE, '`', '^', '['}, {USB_RIGHTBRACE, '+', '*', ']'},
+    {USB_APOSTROPHE, 0, 0, '{'}, {USB_BACKSLASH, 0, 0, '}'},
+    {USB_102ND, '<', '>'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_ES "`^"
+
+static constexpr KeyChars keys_se[] = {
+    {USB_1, '1', '!'}, {USB_2, '2', '"', '@'}, {USB_3, '3', '#'},
+    {USB_4, '4', 0, '$'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/', '{'}, {USB_8, '8', '(', '['}, {USB_9, '9', ')', ']'},
+    {USB_0, '0', '=', '}'}, {USB_MINUS, '+', '?', '\\'}, {USB_EQUAL, 0, '`'},
+    {USB_RIGHTBRACE, 0, '^', '~'},
+    {USB_BACKSLASH, '\'', '*'},
+    {USB_102ND, '<', '>', '|'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_SE "`^~"
+
+// Swiss French and Swiss German only differ in non-ASCII characters
+static constexpr KeyChars keys_ch[] = {
+    {USB_1, '1', '+', '|'}, {USB_2, '2', '"', '@'}, {USB_3, '3', '*', '#'},
+    {USB_4, '4'}, {USB_5, '5', '%'}, {USB_6, '6', '&'},
+    {USB_7, '7', '/'}, {USB_8, '8', '('}, {USB_9, '9', ')'},
+    {USB_0, '0', '='}, {USB_MINUS, '\'', '?'}, {USB_EQUAL, '^', '`', '~'},
+    {USB_Y, 'z', 'Z'}, {USB_LEFTBRACE, 0, 0, '['}, {USB_RIGHTBRACE, 0, '!', ']'},
+    {USB_APOSTROPHE, 0, 0, '{'}, {USB_BACKSLASH, '$', 0, '}'},
+    {USB_102ND, '<', '>', '\\'}, {USB_Z, 'y', 'Y'},
+    {USB_COMMA, ',', ';'}, {USB_DOT, '.', ':'}, {USB_SLASH, '-', '_'}
+};
+#define DEAD_CH "^`~"
+
+static constexpr KeyChars keys_uk[] = {
+    {USB_GRAVE, '`'},
+    {USB_1, '1', '!'}, {USB_2, '2', '"'}, {USB_3, '3'},
+    {USB_4, '4', '$'}, {USB_5, '5', '%'}, {USB_6, '6', '^'},
+    {USB_7, '7', '&'}, {USB_8, '8', '*'}, {USB_9, '9', '('},
+    {USB_0, '0', ')'}, {USB_MINUS, '-', '_'}, {USB_EQUAL, '=', '+'},
+    {USB_LEFTBRACE, '[', '{'}, {USB_RIGHTBRACE, ']', '}'},
+    {USB_SEMICOLON, ';', ':'}, {USB_APOSTROPHE, '\'', '@'},
+    {USB_BACKSLASH, '#', '~'},
+    {USB_102ND, '\\', '|'},
+    {USB_COMMA, ',', '<'}, {USB_DOT, '.', '>'}, {USB_SLASH, '/', '?'}
+};
+#define DEAD_UK ""
+
+/*
+    Compile time reverse lookup: which key to press with which modifiers to
+    get character c. The result is a 16 bit code as in sun_to_usb.h, i.e.
+    modifiers in the high byte and USB scan code in the low byte, or 0 if c
+    can't be typed. Plain keys are preferred over Shift, over AltGr, and so
+    on, and layout specific keys over common ones.
+ */
+constexpr char keyChar(const KeyChars& k, uint8_t level) {
+    return level == 0 ? k.base : level == 1 ? k.shift :
+        level == 2 ? k.altgr : k.shiftAltgr;
+}
+
+constexpr uint8_t levelModifiers(uint8_t level) {
+    return level == 0 ? 0 : level == 1 ? USB_MOD_LSHIFT :
+        level == 2 ? USB_MOD_RALT : USB_MOD_LSHIFT | USB_MOD_RALT;
+}
+
+constexpr uint8_t findKey(const KeyChars* keys, uint8_t n, char c,
+    uint8_t level, uint8_t i = 0) {
+    return i == n || keyChar(keys[i], level) == c ? i :
+        findKey(keys, n, c, level, i + 1);
+}
+
+constexpr uint16_t levelCode(const KeyChars* keys, uint8_t n, char c,
+    uint8_t level) {
+    return findKey(keys, n, c, level) == n ? 0 :
+        levelModifiers(level) << 8 | keys[findKey(keys, n, c, level)].usage;
+}
+
+constexpr uint16_t charCode(const KeyChars* keys, uint8_t n, char c,
+    uint8_t level = 0) {
+    return level == 4 ? 0 :
+        levelCode(keys, n, c, level) != 0 ? levelCode(keys, n, c, level) :
+        levelCode(keys_common, array_len(keys_common), c, level) != 0 ?
+            levelCode(keys_common, array_len(keys_common), c, level) :
+        charCode(keys, n, c, level + 1);
+}
+
+#define CHAR_CODE(keys, c) charCode((keys), array_len(keys), (c))
+
+/*
+    Everything that depends on the layout of the host, which we assume to be
+    the same as the one set on the keyboard: key codes for characters, and
+    the macro table. All of it is in flash, one LayoutMap per layout, so
+    selecting a layout just swaps the pointer.
+ */
+struct LayoutMap {
+    const uint16_t* codes;
+    const char* dead;
+    const uint8_t* const* macros;
+};
+
+class HostLayout {
+
+private:
+    const LayoutMap* map; // in flash
+
+public:
+    HostLayout();
+    void select(uint8_t layout);
+    uint16_t charCode(char c);
+    bool isDead(char c);
+    const uint8_t* macro(uint8_t ix);
+};
+
+extern HostLayout hostLayout;
+
+#endif
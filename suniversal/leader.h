@@ -0,0 +1,198 @@
+/*
+    leader - key sequences started with a leader key, that run macros
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LEADER_h
+#define LEADER_h
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "macros.h"
+#include "usb_codes.h"
+
+/*
+    After the leader key (LEADER_CODE in sun_to_usb.h, Help by default), the
+    next few keys are a sequence that runs a macro, e.g. Help G S types
+    "git status". The keys of the sequence are not sent to the host. If no
+    sequence matches, or LEADER_TIMEOUT runs out between two keys, leader
+    mode ends. A sequence that's the beginning of a longer one runs when the
+    timeout is up.
+
+    Keys are USB scan codes, i.e. they name the key position on a US layout.
+    Modifiers are passed on, so they can't be part of a sequence. Any other
+    code, e.g. a media key or macro, ends leader mode and goes on as well.
+
+    The table is kept sorted, so all sequences starting with the keys typed
+    so far are next to each other. That makes them a trie: a node is the
+    first of the sequences starting with the same keys, plus how many keys
+    those are, and going from one node to the next is a lookup in a
+    transition table built from the sequences at compile time, see below.
+    It all stays in flash, so adding sequences doesn't cost any RAM.
+ */
+#define LEADER_MAX_KEYS 4
+
+struct LeaderSequence {
+    uint8_t keys[LEADER_MAX_KEYS]; // unused ones 0 at the end
+    const uint8_t* macro;          // see macros.h
+};
+
+static constexpr uint8_t leader_git_status[] PROGMEM =
+    {M_TEXT(TEXT_GIT_STATUS), M_END};
+static constexpr uint8_t leader_lock[] PROGMEM =
+    {M_MODS(USB_MOD_LMETA), M_TAP(USB_L), M_END};
+static constexpr uint8_t leader_terminal[] PROGMEM =
+    {M_MODS(USB_MOD_LCTRL | USB_MOD_LALT), M_TAP(USB_T), M_END};
+
+// needs to be sorted by keys, see leaderSorted below
+static constexpr LeaderSequence leaderSequences[] PROGMEM = {
+    {{USB_G, USB_S},        leader_git_status},
+    {{USB_L, USB_O},        leader_lock},
+    {{USB_T, USB_E, USB_R}, leader_terminal}
+};
+
+constexpr bool leaderLess(const uint8_t* a, const uint8_t* b, uint8_t i = 0) {
+    return i == LEADER_MAX_KEYS ? false :
+        a[i] != b[i] ? a[i] < b[i] : leaderLess(a, b, i + 1);
+}
+
+constexpr bool leaderSorted(uint8_t i = 1) {
+    return i >= array_len(leaderSequences) ? true :
+        leaderLess(leaderSequences[i - 1].keys, leaderSequences[i].keys) &&
+        leaderSorted(i + 1);
+}
+
+static_assert(leaderSorted(),
+    "leader sequences need to be unique, and sorted by keys");
+static_assert(array_len(leaderSequences) < 128, "too many leader sequences");
+
+constexpr uint8_t leaderKey(uint8_t i, uint8_t d) {
+    return leaderSequences[i].keys[d];
+}
+
+constexpr bool leaderPlain(uint8_t i = 0, uint8_t d = 0) {
+    return i == array_len(leaderSequences) ? true :
+        d == LEADER_MAX_KEYS ? leaderPlain(i + 1) :
+        leaderKey(i, d) < 0x80 && leaderPlain(i, d + 1);
+}
+
+static_assert(leaderPlain(), "leader sequence keys need to be below 0x80");
+
+/*
+    Transition table. The keys used in sequences are numbered from 1 on, in
+    LeaderColumns, which has 0 for all other keys. Each node (i, d), i.e.
+    sequence i with d keys typed, has a row of leaderKeys entries at
+    (i * LEADER_MAX_KEYS + d) * leaderKeys, one per key. An entry is the
+    sequence the next node starts at, with LEADER_UNIQUE set if it's the
+    only one left, or LEADER_NONE if no sequence goes on with that key.
+    Rows for sequences that aren't the first of a node are never used.
+ */
+#define LEADER_NONE   0xFF
+#define LEADER_UNIQUE 0x80
+
+// whether sequences i and j start with the same d keys
+constexpr bool leaderSame(uint8_t i, uint8_t j, uint8_t d) {
+    return d == 0 ? true :
+        leaderKey(i, d - 1) == leaderKey(j, d - 1) && leaderSame(i, j, d - 1);
+}
+
+// whether key is in any sequence from i on
+constexpr bool leaderUses(uint8_t key, uint8_t i = 0, uint8_t d = 0) {
+    return i == array_len(leaderSequences) ? false :
+        d == LEADER_MAX_KEYS ? leaderUses(key, i + 1) :
+        leaderKey(i, d) == key || leaderUses(key, i, d + 1);
+}
+
+// number of keys below key used in sequences, not counting 0
+constexpr uint8_t leaderUsedBelow(uint8_t key) {
+    return key <= 1 ? 0 : leaderUses(key - 1) + leaderUsedBelow(key - 1);
+}
+
+static constexpr uint8_t leaderKeys = leaderUsedBelow(0x80);
+
+constexpr uint8_t leaderColumn(uint16_t key) {
+    return key != 0 && leaderUses(key) ? leaderUsedBelow(key) + 1 : 0;
+}
+
+constexpr uint8_t leaderColumnKey(uint8_t column, uint8_t key = 1) {
+    return key == 0x80 || leaderColumn(key) == column ? key :
+        leaderColumnKey(column, key + 1);
+}
+
+// next node from node (i, d) with key, looking from sequence j on
+constexpr uint8_t leaderFind(uint8_t i, uint8_t d, uint8_t key, uint8_t j) {
+    return j == array_len(leaderSequences) || !leaderSame(i, j, d) ?
+        LEADER_NONE :
+        leaderKey(j, d) != key ? leaderFind(i, d, key, j + 1) :
+        j + 1u < array_len(leaderSequences) && leaderSame(j, j + 1, d + 1) ?
+        j : j | LEADER_UNIQUE;
+}
+
+constexpr uint8_t leaderNext(uint16_t e) {
+    return leaderFind(e / leaderKeys / LEADER_MAX_KEYS,
+        e / leaderKeys % LEADER_MAX_KEYS, leaderColumnKey(e % leaderKeys + 1),
+        e / leaderKeys / LEADER_MAX_KEYS);
+}
+
+/*
+    Flash table with entry n set to Entry(n), for n in I. There are no loops
+    in C++11 constexpr functions, so the indexes are generated as a parameter
+    pack, by halves, which keeps template nesting shallow.
+ */
+template <uint16_t... I> struct LeaderIndexes {};
+
+template <class A, class B> struct LeaderJoin;
+
+template <uint16_t... A, uint16_t... B>
+struct LeaderJoin<LeaderIndexes<A...>, LeaderIndexes<B...> > {
+    typedef LeaderIndexes<A..., (sizeof...(A) + B)...> type;
+};
+
+template <uint16_t N> struct LeaderRange {
+    typedef typename LeaderJoin<typename LeaderRange<N / 2>::type,
+        typename LeaderRange<N - N / 2>::type>::type type;
+};
+
+template <> struct LeaderRange<0> {
+    typedef LeaderIndexes<> type;
+};
+
+template <> struct LeaderRange<1> {
+    typedef LeaderIndexes<0> type;
+};
+
+template <uint8_t (*Entry)(uint16_t), class I> struct LeaderTable;
+
+template <uint8_t (*Entry)(uint16_t), uint16_t... I>
+struct LeaderTable<Entry, LeaderIndexes<I...> > {
+    static constexpr uint8_t data[sizeof...(I)] PROGMEM = {Entry(I)...};
+};
+
+template <uint8_t (*Entry)(uint16_t), uint16_t... I>
+constexpr uint8_t LeaderTable<Entry, LeaderIndexes<I...> >::data[sizeof...(I)];
+
+static_assert(array_len(leaderSequences) * LEADER_MAX_KEYS * leaderKeys <=
+    0xFFFF, "leader transition table too large");
+
+typedef LeaderTable<leaderColumn, LeaderRange<0x80>::type> LeaderColumns;
+typedef LeaderTable<leaderNext, LeaderRange<
+    array_len(leaderSequences) * LEADER_MAX_KEYS * leaderKeys>::type>
+    LeaderTransitions;
+
+#endif
@@ -18,78 +18,348 @@
     along with suniversal. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <Arduino.h>
+
 #include "config.h"
+#include "layouts.h"
 #include "macros.h"
 
-// individual macros
-static const uint16_t macro_again[]   = {CONTROL, USB_Y, 0};
-static const uint16_t macro_undo[]    = {CONTROL, USB_Z, 0};
-static const uint16_t macro_undo_fr[] = {CONTROL, USB_W, 0};
-static const uint16_t macro_copy[]    = {CONTROL, USB_C, 0};
-static const uint16_t macro_paste[]   = {CONTROL, USB_V, 0};
-static const uint16_t macro_cut[]     = {CONTROL, USB_X, 0};
-
-static const uint16_t macro_stop[]    = {CONTROL, USB_SYSRQ, 0};
-static const uint16_t macro_props[]   = {ALT, USB_ENTER, 0};
-static const uint16_t macro_front[]   = {ALT, USB_TAB, 0};
-static const uint16_t macro_open[]    = {CONTROL, USB_O, 0};
-static const uint16_t macro_find[]    = {CONTROL, USB_F, 0};
-
-static const uint16_t macro_help[]    = {ALT, USB_H, 0};
+/*
+    Macros that press letter keys depend on the layout of the host. If we
+    want to send Ctrl-Z for an Undo, we have to press the key that carries
+    the Z on that layout, which on a German layout for example is the Y key.
+    So these macros get generated for each layout, with the keys looked up
+    by the compiler in the layout definitions in layouts.h. Use KEY(K, c) for
+    the key of letter c on layout K.
+ */
+#define KEY(K, c) ((uint8_t)CHAR_CODE(K, (c)))
+
+#define LAYOUT_MACROS(L, K) \
+    static constexpr uint8_t macro_again_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'y')), M_END}; \
+    static constexpr uint8_t macro_undo_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'z')), M_END}; \
+    static constexpr uint8_t macro_copy_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'c')), M_END}; \
+    static constexpr uint8_t macro_paste_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'v')), M_END}; \
+    static constexpr uint8_t macro_cut_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'x')), M_END}; \
+    static constexpr uint8_t macro_open_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'o')), M_END}; \
+    static constexpr uint8_t macro_find_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LCTRL), M_PRESS(KEY(K, 'f')), M_END}; \
+    static constexpr uint8_t macro_help_##L[] PROGMEM = \
+        {M_MODS(USB_MOD_LALT), M_PRESS(KEY(K, 'h')), M_END}; \
+    const uint8_t* const macros_##L[END_OF_MACROS] PROGMEM = { \
+        /* MACRO_AGAIN */ macro_again_##L, \
+        /* MACRO_UNDO  */ macro_undo_##L, \
+        /* MACRO_COPY  */ macro_copy_##L, \
+        /* MACRO_PASTE */ macro_paste_##L, \
+        /* MACRO_CUT   */ macro_cut_##L, \
+        /* MACRO_STOP  */ macro_stop, \
+        /* MACRO_PROPS */ macro_props, \
+        /* MACRO_FRONT */ macro_front, \
+        /* MACRO_OPEN  */ macro_open_##L, \
+        /* MACRO_FIND  */ macro_find_##L, \
+        /* MACRO_HELP  */ macro_help_##L \
+    }
+
+// macros that are the same for all layouts
+static const uint8_t macro_stop[] PROGMEM =
+    {M_MODS(USB_MOD_LCTRL), M_PRESS(USB_SYSRQ), M_END};
+static const uint8_t macro_props[] PROGMEM =
+    {M_MODS(USB_MOD_LALT), M_PRESS(USB_ENTER), M_END};
+static const uint8_t macro_front[] PROGMEM =
+    {M_MODS(USB_MOD_LALT), M_PRESS(USB_TAB), M_END};
+
+// one macro table per layout, selected via HostLayout (see layouts.h)
+LAYOUT_MACROS(us, keys_us);
+LAYOUT_MACROS(fr, keys_fr);
+LAYOUT_MACROS(ca, keys_ca);
+LAYOUT_MACROS(dk, keys_dk);
+LAYOUT_MACROS(de, keys_de);
+LAYOUT_MACROS(it, keys_it);
+LAYOUT_MACROS(nl, keys_nl);
+LAYOUT_MACROS(no, keys_no);
+LAYOUT_MACROS(pt, keys_pt);
+LAYOUT_MACROS(es, keys_es);
+LAYOUT_MACROS(se, keys_se);
+LAYOUT_MACROS(ch, keys_ch);
+LAYOUT_MACROS(uk, keys_uk);
+
+// these used to be patched in at runtime
+static_assert(macro_undo_fr[3] == USB_W, "French Undo should be Ctrl-W key");
+static_assert(macro_undo_de[3] == USB_Y, "German Undo should be Ctrl-Y key");
+static_assert(macro_again_de[3] == USB_Z, "German Again should be Ctrl-Z key");
+static_assert(macro_undo_ch[3] == USB_Y, "Swiss Undo should be Ctrl-Y key");
+
+// texts, use with M_TEXT, e.g. {M_TEXT(TEXT_EXAMPLE), M_END}
+static const char text_example[] PROGMEM = "suniversal\n";
+static const char text_git_status[] PROGMEM = "git status\n";
+
+static const char* const texts[END_OF_TEXTS] PROGMEM = {
+    text_example,
+    text_git_status
+};
 //
 
-MacroTable::MacroTable() {
-    DPRINTLN("populating macro table");
-    table[MACRO_AGAIN] = macro_again;
-    table[MACRO_UNDO]  = macro_undo;
-    table[MACRO_COPY]  = macro_copy;
-    table[MACRO_PASTE] = macro_paste;
-    table[MACRO_CUT]   = macro_cut;
-    table[MACRO_STOP]  = macro_stop;
-    table[MACRO_PROPS] = macro_props;
-    table[MACRO_FRONT] = macro_front;
-    table[MACRO_OPEN]  = macro_open;
-    table[MACRO_FIND]  = macro_find;
-    table[MACRO_HELP]  = macro_help;
+/*
+    macro player
+ */
+MacroPlayer::MacroPlayer() :
+    pc(NULL),
+    pending(NULL),
+    down(false),
+    tapping(false),
+    waiting(false),
+    text(NULL),
+    mods(0),
+    heldCount(0)
+{}
+
+/*
+    Start macro program when its key `ix` is pressed. If another macro is
+    still active, it gets aborted, and this one starts once all keys held
+    by the other one have been released.
+ */
+void MacroPlayer::start(const uint8_t* macro, uint8_t ix) {
+    DPRINTLN("MacroPlayer.start: " + String(ix));
+    if (busy()) {
+        pc = NULL;
+        down = false;
+        pending = macro;
+        pendingId = ix;
+        pendingDown = true;
+    } else {
+        load(macro, ix, true);
+    }
 }
 
-uint16_t* MacroTable::get(uint8_t ix) {
-    return table[ix];
+/*
+    Macro key `ix` has been released. The program still runs to its end, and
+    whatever it holds after that gets released.
+ */
+void MacroPlayer::stop(uint8_t ix) {
+    DPRINTLN("MacroPlayer.stop: " + String(ix));
+    if (pending != NULL && ix == pendingId) {
+        pendingDown = false;
+    } else if (ix == id) {
+        down = false;
+    }
+}
+
+/*
+    Whether there's still anything left to do.
+ */
+bool MacroPlayer::busy() {
+    return pc != NULL || pending != NULL || mods != 0 || heldCount > 0;
 }
 
 /*
-    For the different keyboard layouts see:
-        https://docs.oracle.com/cd/E19683-01/806-6642/new-357/index.html
+    Get the next change to make to the key report. Returns false if there
+    is nothing to do right now.
  */
-MacroTable::adjustToLayout(uint8_t layout) {
-    switch (layout) {
-        case FRENCH_BELGIUM:
-            DPRINTLN("adjusting macro for French/Belgium layout");
-            table[MACRO_UNDO] = macro_undo_fr;
-            break;
-
-        case GERMANY:
-        case SWISS_FRENCH:
-        case SWISS_GERMAN:
-            DPRINTLN("adjusting macro for German/Swiss layout");
-            table[MACRO_AGAIN] = macro_undo;
-            table[MACRO_UNDO] = macro_again;
-            break;
+bool MacroPlayer::next(uint16_t& code, bool& pressed) {
+    if (pc != NULL) {
+        return step(code, pressed);
+    }
+    if (!down && releaseHeld(code, pressed)) {
+        return true;
+    }
+    if (pending != NULL && mods == 0 && heldCount == 0) {
+        load(pending, pendingId, pendingDown);
+        pending = NULL;
+        return step(code, pressed);
+    }
+    return false;
+}
+
+void MacroPlayer::load(const uint8_t* macro, uint8_t ix, bool pressed) {
+    pc = macro;
+    id = ix;
+    down = pressed;
+    tapping = false;
+    waiting = false;
+    text = NULL;
+}
+
 /*
-    currently, nothing to do for these layouts
-
-        case CANADA_FRENCH:
-        case DENMARK:
-        case ITALY:
-        case NETHERLANDS:
-        case NORWAY:
-        case PORTUGAL:
-        case SPAIN_LATIN_AMERICA:
-        case SWEDEN_FINLAND:
-        case UNITED_KINGDOM:
-            break;
+    Execute ops until one of them produces a change to the key report, or
+    we need to wait. An op that needs more than one report stays current
+    until it's complete.
  */
-        default:
-            break;
+bool MacroPlayer::step(uint16_t& code, bool& pressed) {
+
+    while (pc != NULL) {
+
+        uint8_t op = pgm_read_byte(pc);
+        uint8_t arg = pgm_read_byte(pc + 1);
+
+        switch (op) {
+
+            case OP_PRESS:
+                pc += 2;
+                if (hold(arg)) {
+                    code = arg;
+                    pressed = true;
+                    return true;
+                }
+                break;
+
+            case OP_RELEASE:
+                pc += 2;
+                if (unhold(arg)) {
+                    code = arg;
+                    pressed = false;
+                    return true;
+                }
+                break;
+
+            case OP_TAP:
+                code = arg;
+                pressed = !tapping;
+                tapping = !tapping;
+                if (!tapping) {
+                    pc += 2;
+                }
+                return true;
+
+            case OP_WAIT:
+                if (!waiting) {
+                    waiting = true;
+                    waitStart = millis();
+                }
+                if (millis() - waitStart < (arg | pgm_read_byte(pc + 2) << 8)) {
+                    return false;
+                }
+                waiting = false;
+                pc += 3;
+                break;
+
+            case OP_MODS:
+                // press added modifiers first, then release dropped ones
+                if ((arg & ~mods) != 0) {
+                    code = (arg & ~mods) << 8;
+                    pressed = true;
+                    mods |= arg;
+                    return true;
+                }
+                if ((mods & ~arg) != 0) {
+                    code = (mods & ~arg) << 8;
+                    pressed = false;
+                    mods = arg;
+                    return true;
+                }
+                pc += 2;
+                break;
+
+            case OP_TEXT:
+                if (text == NULL) {
+                    text = (const char*)pgm_read_ptr(&texts[arg]);
+                    phase = 0;
+                }
+                if (typeText(code, pressed)) {
+                    return true;
+                }
+                text = NULL;
+                pc += 2;
+                break;
+
+            default: // OP_END
+                pc = NULL;
+                return !down && releaseHeld(code, pressed);
+        }
+    }
+
+    return false;
+}
+
+/*
+    Type the next character of the current text. Each character is pressed
+    and released, with modifiers as needed for the layout. Characters that
+    need a dead key get a space afterwards. Characters the layout doesn't
+    have are skipped. Returns false when the text is done.
+ */
+bool MacroPlayer::typeText(uint16_t& code, bool& pressed) {
+
+    char c;
+
+    while ((c = pgm_read_byte(text)) != 0) {
+
+        // leave modifiers alone that the macro holds itself
+        uint16_t k = hostLayout.charCode(c) & ~(mods << 8);
+
+        if (k == 0) {
+            text++;
+            continue;
+        }
+
+        switch (phase++) {
+            case 0:
+                code = k;
+                pressed = true;
+                return true;
+            case 1:
+                code = k;
+                pressed = false;
+                if (!hostLayout.isDead(c)) {
+                    phase = 0;
+                    text++;
+                }
+                return true;
+            case 2:
+                code = USB_SPACE;
+                pressed = true;
+                return true;
+            default:
+                code = USB_SPACE;
+                pressed = false;
+                phase = 0;
+                text++;
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    Release modifiers first, then held keys one by one.
+ */
+bool MacroPlayer::releaseHeld(uint16_t& code, bool& pressed) {
+    pressed = false;
+    if (mods != 0) {
+        code = mods << 8;
+        mods = 0;
+        return true;
+    }
+    if (heldCount > 0) {
+        code = held[--heldCount];
+        return true;
+    }
+    return false;
+}
+
+bool MacroPlayer::hold(uint8_t k) {
+    for (uint8_t i = 0; i < heldCount; i++) {
+        if (held[i] == k) {
+            return false;
+        }
+    }
+    if (heldCount == MACRO_MAX_HELD) {
+        return false;
+    }
+    held[heldCount++] = k;
+    return true;
+}
+
+bool MacroPlayer::unhold(uint8_t k) {
+    for (uint8_t i = 0; i < heldCount; i++) {
+        if (held[i] == k) {
+            held[i] = held[--heldCount];
+            return true;
+        }
     }
+    return false;
 }
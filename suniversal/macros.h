@@ -24,8 +24,44 @@
 #include <stdint.h>
 #include "usb_codes.h"
 
-#define CONTROL (USB_MOD_LCTRL << 8)
-#define ALT     (USB_MOD_LALT  << 8)
+/*
+    Macros are little programs in flash, written as a byte array with the
+    helpers below. A macro starts when its key is pressed, and can run
+    while the user keeps typing. It emits at most one change to the key
+    report per USB poll, so it never blocks the main loop.
+
+    Keys and modifiers that are still held when the program ends stay down
+    until the macro key is released. That way, holding e.g. Paste gets
+    auto-repeated by the host just like Ctrl-V would.
+ */
+#define OP_END      0x00
+#define OP_PRESS    0x01
+#define OP_RELEASE  0x02
+#define OP_TAP      0x03
+#define OP_WAIT     0x04
+#define OP_MODS     0x05
+#define OP_TEXT     0x06
+
+// press key k and hold it
+#define M_PRESS(k)   OP_PRESS, (k)
+// release key k
+#define M_RELEASE(k) OP_RELEASE, (k)
+// press & release key k
+#define M_TAP(k)     OP_TAP, (k)
+// wait for ms milliseconds, up to 65535
+#define M_WAIT(ms)   OP_WAIT, ((ms) & 0xFF), (((ms) >> 8) & 0xFF)
+// set held modifiers to mask m, e.g. USB_MOD_LCTRL | USB_MOD_LSHIFT
+#define M_MODS(m)    OP_MODS, (m)
+// type text number ix, see TEXTS below
+#define M_TEXT(ix)   OP_TEXT, (ix)
+// end of macro
+#define M_END        OP_END
+
+// macro ID for macros run from leader sequences, see leader.h
+#define LEADER_MACRO_ID 0x80
+
+// max number of keys a macro can hold at once
+#define MACRO_MAX_HELD 6
 
 // macro index numbers
 enum MACROS {
@@ -43,15 +79,70 @@ enum MACROS {
     END_OF_MACROS
 };
 
-class MacroTable {
+/*
+    Text index numbers. Texts are typed according to the keyboard layout (see
+    layouts.h), one character per two reports (press & release), so repeated
+    characters always come through.
+ */
+enum TEXTS {
+    TEXT_EXAMPLE = 0,
+    TEXT_GIT_STATUS,
+    END_OF_TEXTS
+};
+
+/*
+    Macro tables, one per layout, in flash. See LAYOUT_MACROS in macros.cpp.
+ */
+extern const uint8_t* const macros_us[END_OF_MACROS];
+extern const uint8_t* const macros_fr[END_OF_MACROS];
+extern const uint8_t* const macros_ca[END_OF_MACROS];
+extern const uint8_t* const macros_dk[END_OF_MACROS];
+extern const uint8_t* const macros_de[END_OF_MACROS];
+extern const uint8_t* const macros_it[END_OF_MACROS];
+extern const uint8_t* const macros_nl[END_OF_MACROS];
+extern const uint8_t* const macros_no[END_OF_MACROS];
+extern const uint8_t* const macros_pt[END_OF_MACROS];
+extern const uint8_t* const macros_es[END_OF_MACROS];
+extern const uint8_t* const macros_se[END_OF_MACROS];
+extern const uint8_t* const macros_ch[END_OF_MACROS];
+extern const uint8_t* const macros_uk[END_OF_MACROS];
+
+/*
+    Interpreter for macro programs. The player does not send anything itself,
+    but hands out the next change to make to the key report via next(), as
+    16 bit code like in sun_to_usb.h. Call that whenever another report can
+    be sent.
+ */
+class MacroPlayer {
 
 private:
-    uint16_t* table[END_OF_MACROS];
+    const uint8_t* pc;      // next op, NULL when program has ended
+    const uint8_t* pending; // macro to start once the current one is done
+    uint8_t id;
+    uint8_t pendingId;
+    bool down;              // whether macro key is still held
+    bool pendingDown;
+    bool tapping;
+    bool waiting;
+    const char* text;       // next character of text being typed
+    uint8_t phase;
+    unsigned long waitStart;
+    uint8_t mods;
+    uint8_t held[MACRO_MAX_HELD];
+    uint8_t heldCount;
+    void load(const uint8_t* macro, uint8_t ix, bool pressed);
+    bool hold(uint8_t k);
+    bool unhold(uint8_t k);
+    bool step(uint16_t& code, bool& pressed);
+    bool typeText(uint16_t& code, bool& pressed);
+    bool releaseHeld(uint16_t& code, bool& pressed);
 
 public:
-    MacroTable();
-    adjustToLayout(uint8_t layout);
-    uint16_t* get(uint8_t ix);
+    MacroPlayer();
+    void start(const uint8_t* macro, uint8_t ix);
+    void stop(uint8_t ix);
+    bool busy();
+    bool next(uint16_t& code, bool& pressed);
 };
 
 #endif
@@ -20,6 +20,9 @@
 
 #include "config.h"
 #include "mouse.h"
+#include "mouse_keys.h"
+#include "power.h"
+#include "pipeline.h"
 
 /*
     The mouse I tested this with is a model Compact 1, SUN no. 370-1586-03.
@@ -52,8 +55,13 @@
 #define BUTTON_MIDDLE_MASK 0x02
 #define BUTTON_LEFT_MASK   0x04
 
-#define DATA_FRAME_START   0x80
-#define FRAME_START_MASK   0xf8
+// the mouse sends frames without pause, so a longer pause marks a frame
+// start; a byte takes a bit over 9ms at 1200 baud
+#define FRAME_GAP          25
+// how far the protocol score goes, and at which score a protocol counts as
+// detected; the difference gives the hysteresis for switching
+#define SCORE_MAX          8
+#define SCORE_DETECTED     4
 
 #define IX_BUTTONS 0
 #define IX_DX_A    1
@@ -62,115 +70,464 @@
 #define IX_DY_B    4
 
 /*
-
+    mouse pipeline stages, see pipeline.h
  */
-MouseConverter::MouseConverter() {
-	bufferIx = 0;
-	frameLength = 0;
-	fiveBytes = false;
-}
 
 /*
+    The serial mouse sends a frame only every 25 to 45 ms, depending on
+    protocol. Instead of moving the pointer in one jump per frame, this
+    spreads each frame's motion evenly over the USB polls until the next
+    frame is expected, so the pointer moves smoothly. Total motion stays
+    exactly what the mouse sent.
+
+    The time until the next frame is predicted from the intervals between
+    recent frames, but never longer than MOUSE_INTERPOLATION_LATENCY, which
+    bounds the latency this adds. When a frame arrives before the previous
+    one is done, the rest of the previous one is sent right away. Button
+    changes also send any motion still pending first, so clicks land where
+    the pointer was meant to be.
+ */
+#define FRAME_INTERVAL   40 // initial prediction, ms
+#define FRAME_SAME       2  // moves closer than this belong to the same frame
+
+template <class Next>
+struct InterpolationStage : MouseStage<Next> {
+
+	static int16_t restX;
+	static int16_t restY;
+	static uint16_t interval; // predicted time between frames
+	static unsigned long arrival; // when current frame came in
+	static unsigned long last; // when motion was last sent
+	static unsigned long deadline; // when current frame has to be done
+
+	static void handleButtons(uint8_t b) {
+		flush(millis());
+		Next::handleButtons(b);
+	}
+
+	static void handleMove(int8_t dx, int8_t dy) {
+
+		unsigned long now = millis();
+		unsigned long gap = now - arrival;
+
+		if (gap >= FRAME_SAME) {
+			flush(now);
+			// ignore gaps while the mouse rested
+			if (gap < 2 * MOUSE_INTERPOLATION_LATENCY) {
+				interval = (3 * interval + gap) / 4;
+			}
+			arrival = now;
+			last = now;
+			deadline = now + min(interval, MOUSE_INTERPOLATION_LATENCY);
+		}
+
+		restX += dx;
+		restY += dy;
+	}
+
+	static void tick() {
+		if (restX != 0 || restY != 0) {
+			unsigned long now = millis();
+			if ((long)(now - deadline) >= 0) {
+				flush(now);
+			} else if (now != last) {
+				// share of the rest that's due by now
+				long span = deadline - last;
+				long elapsed = now - last;
+				send((long)restX * elapsed / span,
+					(long)restY * elapsed / span);
+				last = now;
+			}
+		}
+		Next::tick();
+	}
+
+	static bool busy() {
+		return restX != 0 || restY != 0 || Next::busy();
+	}
+
+	/*
+	    Send everything that's left of the current frame.
+	 */
+	static void flush(unsigned long now) {
+		if (restX != 0 || restY != 0) {
+			send(restX, restY);
+			uint16_t latency = now - arrival;
+			mouseLatency.last = latency;
+			if (latency > mouseLatency.max) {
+				mouseLatency.max = latency;
+			}
+			mouseLatency.frames++;
+			DPRINTLN("InterpolationStage.flush: frame done after " +
+				String(latency) + "ms");
+		}
+	}
 
+	static void send(int16_t dx, int16_t dy) {
+		restX -= dx;
+		restY -= dy;
+		// two 5-byte protocol deltas can exceed what fits into one report
+		while (dx != 0 || dy != 0) {
+			int8_t x = constrain(dx, -127, 127);
+			int8_t y = constrain(dy, -127, 127);
+			Next::handleMove(x, y);
+			dx -= x;
+			dy -= y;
+		}
+	}
+};
+
+template <class Next> int16_t InterpolationStage<Next>::restX = 0;
+template <class Next> int16_t InterpolationStage<Next>::restY = 0;
+template <class Next>
+uint16_t InterpolationStage<Next>::interval = FRAME_INTERVAL;
+template <class Next> unsigned long InterpolationStage<Next>::arrival = 0;
+template <class Next> unsigned long InterpolationStage<Next>::last = 0;
+template <class Next> unsigned long InterpolationStage<Next>::deadline = 0;
+
+MouseLatency mouseLatency;
+MouseSync mouseSync;
+
+/*
+    When the middle button is held, turn movements into scrolling.
  */
-MouseConverter::update(uint8_t data) {
-	frameLength++;
-	// we need to sync on data frame start
-	if ((data & FRAME_START_MASK) == DATA_FRAME_START) {
-		flushBuffer();
-		buffer[0] = data;
-		bufferIx = 1;
-		fiveBytes = frameLength == 5; // determine protocol
-		frameLength = 0;
-	} else if (bufferIx > 0) {
-		buffer[bufferIx++] = data;
-		flushBuffer();
+template <class Next>
+struct ScrollEmulationStage : MouseStage<Next> {
+
+	static uint8_t buttons;
+
+	static void handleButtons(uint8_t b) {
+		buttons = b;
+		Next::handleButtons(b);
 	}
-}
+
+	static void handleMove(int8_t dx, int8_t dy) {
+		if ((buttons & MOUSE_MIDDLE) != 0) {
+			Next::handleScroll(-dy, dx);
+		} else {
+			Next::handleMove(dx, dy);
+		}
+	}
+};
+
+template <class Next> uint8_t ScrollEmulationStage<Next>::buttons = 0;
 
 /*
+    Applies scrolling to the page instead of the view port.
+ */
+template <class Next>
+struct InvertScrollStage : MouseStage<Next> {
+	static void handleScroll(int8_t v, int8_t h) {
+		Next::handleScroll(-v, -h);
+	}
+};
 
+/*
+    End of the pipeline, sends mouse reports.
  */
-MouseConverter::flushBuffer() {
+struct MouseReportStage {
 
-	if ((bufferIx == 3 && !fiveBytes) || bufferIx == 5) {
+	static void handleButtons(uint8_t b) {
+		DPRINTLN("MouseConverter.handleButtons: " + String(b, HEX));
+		usbMouse.release(~b & MOUSE_ALL);
+		usbMouse.press(b);
+	}
 
-		DPRINT("MouseConverter.flushBuffer: [");
-		if (DEBUG) {
-			for (uint8_t i = 0; i < bufferIx; i++) {
-				DPRINT(" " + String(buffer[i], HEX));
-			}
+	static void handleMove(int8_t dx, int8_t dy) {
+		if (dx != 0 || dy != 0) {
+			DPRINTLN("MouseConverter.handleMove: [ dx="
+				+ String(dx) + ", dy=" + String(dy) + "]");
+			usbMouse.move(dx, dy);
 		}
-		DPRINTLN(" ]");
+	}
 
-		uint8_t b = buffer[IX_BUTTONS];
-		handleButtons(b);
+	static void handleScroll(int8_t v, int8_t h) {
+		if (v != 0 || h != 0) {
+			DPRINTLN("MouseConverter.handleScroll: [ v=" +
+				String(v) + ", h=" + String(h) + " ]");
+			usbMouse.scroll(v, h);
+		}
+	}
+
+	static inline void tick() {}
+	static inline bool busy() {
+		return false;
+	}
+};
+
+typedef
+	Use<EMULATE_SCROLL_WHEEL, ScrollEmulationStage,
+	Use<INVERTED_SCROLLING, InvertScrollStage,
+	MouseReportStage> > MouseOutput;
+
+typedef
+	Use<INTERPOLATE_MOUSE, InterpolationStage,
+	MouseOutput> MousePipeline;
+
+/*
 
-		if (EMULATE_SCROLL_WHEEL && (b & BUTTON_MIDDLE_MASK) == 0) {
-			handleScroll(buffer[IX_DY_A], buffer[IX_DX_A]);
-			handleScroll(buffer[IX_DY_B], buffer[IX_DX_B]);
+ */
+MouseConverter::MouseConverter() {
+	bufferIx = 0;
+	// until detected, assume 3-byte protocol; on a 5-byte mouse, that still
+	// decodes the first half of each frame correctly
+	fiveBytes = false;
+	detected = false;
+	history = 0;
+	score = 0;
+	lost = 0;
+	lastByte = 0;
+	buttons = 0;
+	keyButtons = 0;
+	sent = 0;
+}
+
+/*
+    Feed a byte from the mouse. A frame starts with a byte that looks like
+    DATA_FRAME_START, but so can a delta byte, so once in a frame, we take
+    bytes as they come until the frame is complete. If the next byte then
+    isn't a frame start, we're out of sync, and drop bytes until we see one.
+    A pause in the stream also ends a frame, which gets us back in sync
+    after hot-plugging or a lost byte. That way, we're back in sync after at
+    most one frame.
+
+    We only know when a byte was read, not when it came in. Set queued if
+    it was waiting in the buffer along with others, e.g. after the loop got
+    held up. How long it waited then says nothing about a pause, so only
+    bytes that came in on their own are checked for one.
+ */
+void MouseConverter::update(uint8_t data, bool queued) {
+
+	unsigned long now = millis();
+	bool gap = !queued && now - lastByte > FRAME_GAP;
+	lastByte = now;
+
+	bool start = (data & FRAME_START_MASK) == DATA_FRAME_START;
+	detect(start);
+
+	if (gap && bufferIx > 0) {
+		DPRINTLN("MouseConverter.update: frame cut short");
+		lost = bufferIx;
+		bufferIx = 0;
+		mouseSync.misframes++;
+	}
+
+	if (bufferIx == 0) {
+		if (start) {
+			resync();
+			buffer[0] = data;
+			bufferIx = 1;
 		} else {
-			handleMove(buffer[IX_DX_A], buffer[IX_DY_A]);
-			if (bufferIx == 5) {
-				handleMove(buffer[IX_DX_B], buffer[IX_DY_B]);
+			if (lost++ == 0) {
+				mouseSync.misframes++;
 			}
+			mouseSync.dropped++;
 		}
+		return;
+	}
 
-		bufferIx = 0;
+	buffer[bufferIx++] = data;
+	flushBuffer();
+}
+
+/*
+    Protocol detection. In a stream of frames, frame starts are 3 bytes
+    apart for the SUN and 5 bytes apart for the Mousesystems protocol.
+    Whenever a byte looks like a frame start, we check the distance to the
+    previous one that did, and score it. Since a delta byte can look like a
+    frame start too, a single distance decides nothing, only when the score
+    reaches SCORE_DETECTED, we take it as the protocol. The very first
+    distance though sets the protocol right away, so a 5-byte mouse doesn't
+    have its first frames cut in half until the score gets there. Should
+    that have been a delta byte, the score corrects it a few frames later.
+ */
+void MouseConverter::detect(bool start) {
+
+	history = (history << 1) | (start ? 1 : 0);
+	if (!start) {
+		return;
+	}
+
+	if ((history & 0x3E) == 0x20) { // previous start 5 bytes back
+		score = min(score + 1, SCORE_MAX);
+	} else if ((history & 0x0E) == 0x08) { // 3 bytes back
+		score = max(score - 1, -SCORE_MAX);
+	} else {
+		return;
 	}
+
+	if (!detected) {
+		detected = true;
+		fiveBytes = score > 0;
+		DPRINTLN("MouseConverter.detect: assuming " +
+			String(fiveBytes ? "5-byte" : "3-byte") + " protocol");
+		return;
+	}
+
+	if (score >= SCORE_DETECTED && !fiveBytes) {
+		fiveBytes = true;
+	} else if (score <= -SCORE_DETECTED && fiveBytes) {
+		fiveBytes = false;
+	} else {
+		return;
+	}
+
+	mouseSync.switches++;
+	DPRINTLN("MouseConverter.detect: " +
+		String(fiveBytes ? "5-byte" : "3-byte") + " protocol");
+}
+
+/*
+    Start protocol detection over, e.g. after the baud rate changed, and
+    whatever came in before was garbage. The protocol stays as it is until
+    the next frame start distance sets it.
+ */
+void MouseConverter::redetect() {
+	bufferIx = 0;
+	history = 0;
+	score = 0;
+	detected = false;
 }
 
 /*
 
  */
-MouseConverter::handleScroll(uint8_t v, uint8_t h) {
-	if (v != 0 || h != 0) {
-		DPRINTLN("MouseConverter.handleScroll: [ v=" +
-			String(v) + ", h=" + String(h) + " ]");
-		if (INVERTED_SCROLLING) {
-			usbMouse.scroll((0x100 - v) & 0xff, (0x100 - h) & 0xff);
-		} else {
-			usbMouse.scroll(v, h);
+bool MouseConverter::isDetected() {
+	return detected;
+}
+
+/*
+    We're at a frame start, note how long it took to get here if we had
+    lost sync.
+ */
+void MouseConverter::resync() {
+	if (lost > 0) {
+		DPRINTLN("MouseConverter.resync: after " + String(lost) + " bytes");
+		mouseSync.recovery = lost;
+		if (lost > mouseSync.maxRecovery) {
+			mouseSync.maxRecovery = lost;
 		}
+		lost = 0;
 	}
 }
 
 /*
+    A mouse key went down or up, see mouse_keys.h. Buttons held with mouse
+    keys are merged with those of the serial mouse.
+ */
+void MouseConverter::handleMouseKey(uint8_t bits, bool pressed) {
+	mouseKeys.update(bits, pressed);
+	setButtons(buttons, mouseKeys.buttons());
+}
+
+/*
+    Release all buttons and directions held with mouse keys.
+ */
+void MouseConverter::releaseMouseKeys() {
+	mouseKeys.releaseAll();
+	setButtons(buttons, 0);
+}
 
+/*
+    Give pipeline stages a chance to do things over time. Mouse keys motion
+    is sent from here, i.e. at most once per millisecond. This isn't called
+    while suspended, so this is also where buttons released while suspended
+    get released on the host. Ones pressed meanwhile stay dropped.
  */
-MouseConverter::handleMove(uint8_t dx, uint8_t dy) {
-	if (dx != 0 || dy != 0) {
-		dy = (0x100 - dy) & 0xff; // dy is negated two's complement
-		DPRINTLN("MouseConverter.handleMove: [ dx="
-			+ String(dx) + ", dy=" + String(dy) + "]");
-		usbMouse.move(dx, dy);
+void MouseConverter::tick() {
+#if USE_SUSPEND == true
+	if ((sent & ~(buttons | keyButtons)) != 0) {
+		sent &= buttons | keyButtons;
+		MousePipeline::handleButtons(sent);
 	}
+#endif
+#if USE_MOUSE_KEYS == true
+	int8_t dx, dy;
+	if (mouseKeys.step(dx, dy)) {
+		MouseOutput::handleMove(dx, dy);
+	}
+#endif
+	MousePipeline::tick();
 }
 
 /*
+    Whether the next tick has anything to do.
+ */
+bool MouseConverter::busy() {
+#if USE_SUSPEND == true
+	if ((sent & ~(buttons | keyButtons)) != 0) {
+		return true;
+	}
+#endif
+#if USE_MOUSE_KEYS == true
+	if (mouseKeys.moving()) {
+		return true;
+	}
+#endif
+	return MousePipeline::busy();
+}
 
+/*
+    Send buttons down the pipeline when they changed.
  */
-MouseConverter::handleButtons(uint8_t states) {
-	if ((states ^ buttonStates) != 0) { // any changes at all?
-		DPRINTLN("MouseConverter.handleButtons: " + String(states, HEX));
-		handleButton(states, BUTTON_LEFT_MASK, MOUSE_LEFT);
-		handleButton(states, BUTTON_MIDDLE_MASK, MOUSE_MIDDLE);
-		handleButton(states, BUTTON_RIGHT_MASK, MOUSE_RIGHT);
-		buttonStates = states;
+void MouseConverter::setButtons(uint8_t serial, uint8_t keys) {
+	uint8_t before = buttons | keyButtons;
+	buttons = serial;
+	keyButtons = keys;
+	if ((buttons | keyButtons) != before) {
+		sent = buttons | keyButtons;
+		MousePipeline::handleButtons(sent);
 	}
 }
 
 /*
 
  */
-MouseConverter::handleButton(uint8_t states, uint8_t buttonMask, char buttonId) {
-	if (((states ^ buttonStates) & buttonMask) != 0) { // any change for button?
-		if ((states & buttonMask) == 0) {
-			usbMouse.press(buttonId);
-		} else {
-			usbMouse.release(buttonId);
+void MouseConverter::flushBuffer() {
+
+	if ((bufferIx == 3 && !fiveBytes) || bufferIx == 5) {
+
+		DPRINT("MouseConverter.flushBuffer: [");
+#if DEBUG == true
+		for (uint8_t i = 0; i < bufferIx; i++) {
+			DPRINT(" " + String(buffer[i], HEX));
+		}
+#endif
+		DPRINTLN(" ]");
+
+#if USE_SUSPEND == true
+		// a button wakes up the host, but isn't clicked, and motion while
+		// suspended is dropped
+		if (power.isSuspended()) {
+			uint8_t b = decodeButtons(buffer[IX_BUTTONS]);
+			if ((b & ~buttons) != 0) {
+				power.wakeup();
+			}
+			buttons = b;
+			bufferIx = 0;
+			return;
 		}
+#endif
+
+		setButtons(decodeButtons(buffer[IX_BUTTONS]), keyButtons);
+		// dy is negated two's complement
+		MousePipeline::handleMove(buffer[IX_DX_A], -buffer[IX_DY_A]);
+		if (bufferIx == 5) {
+			MousePipeline::handleMove(buffer[IX_DX_B], -buffer[IX_DY_B]);
+		}
+
+		bufferIx = 0;
+		mouseSync.frames++;
 	}
 }
 
+/*
+    Buttons are low active in the protocol, turn them into USB button mask.
+ */
+uint8_t MouseConverter::decodeButtons(uint8_t states) {
+	return ((states & BUTTON_LEFT_MASK) == 0 ? MOUSE_LEFT : 0) |
+		((states & BUTTON_MIDDLE_MASK) == 0 ? MOUSE_MIDDLE : 0) |
+		((states & BUTTON_RIGHT_MASK) == 0 ? MOUSE_RIGHT : 0);
+}
+
 MouseConverter mouseConverter;
@@ -25,23 +25,72 @@
 
 #include "usb_mouse.h"
 
+// first byte of a frame, with the buttons in the lower three bits
+#define DATA_FRAME_START   0x80
+#define FRAME_START_MASK   0xf8
+
+/*
+    Latency added by motion interpolation, in milliseconds, from a frame
+    coming in to its motion being sent in full.
+ */
+struct MouseLatency {
+    uint16_t last;
+    uint16_t max;
+    uint16_t frames;
+};
+
+extern MouseLatency mouseLatency;
+
+/*
+    Counters for how well we're in sync with the mouse:
+
+     - frames:      frames decoded
+     - misframes:   times a frame turned out to be broken, e.g. by a lost byte
+     - dropped:     bytes dropped while looking for the next frame start
+     - switches:    times the detected protocol changed
+     - recovery:    bytes it took to get back in sync the last time
+     - maxRecovery: most bytes it ever took
+ */
+struct MouseSync {
+    uint16_t frames;
+    uint16_t misframes;
+    uint16_t dropped;
+    uint8_t switches;
+    uint8_t recovery;
+    uint8_t maxRecovery;
+};
+
+extern MouseSync mouseSync;
+
 class MouseConverter {
 
 private:
-    uint8_t buttonStates;
     uint8_t buffer[5];
     uint8_t bufferIx;
-    uint8_t frameLength;
     bool fiveBytes;
-    flushBuffer();
-    handleScroll(uint8_t v, uint8_t h);
-    handleMove(uint8_t dx, uint8_t dy);
-    handleButtons(uint8_t state);
-    handleButton(uint8_t states, uint8_t buttonMask, char buttonId);
+    bool detected;       // protocol set from a first frame start distance
+    uint8_t history;     // bit n set if byte n back looked like a frame start
+    int8_t score;        // > 0 speaks for 5-byte, < 0 for 3-byte protocol
+    uint8_t lost;        // bytes dropped since we lost sync
+    unsigned long lastByte;
+    void detect(bool start);
+    void resync();
+    uint8_t buttons;     // buttons held on the serial mouse
+    uint8_t keyButtons;  // buttons held with mouse keys
+    uint8_t sent;        // buttons last sent down the pipeline
+    void flushBuffer();
+    void setButtons(uint8_t serial, uint8_t keys);
+    uint8_t decodeButtons(uint8_t states);
 
 public:
     MouseConverter();
-    update(uint8_t data);
+    void update(uint8_t data, bool queued);
+    void handleMouseKey(uint8_t bits, bool pressed);
+    void releaseMouseKeys();
+    void tick();
+    bool busy();
+    void redetect();
+    bool isDetected();
 };
 
 extern MouseConverter mouseConverter;
@@ -0,0 +1,178 @@
+/*
+    mouse_baud - detecting the baud rate of the mouse
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "mouse.h"
+#include "mouse_baud.h"
+
+// candidate rates, the mouse should use one of these
+static const uint16_t rates[] PROGMEM = {1200, 2400, 4800, 9600, 19200};
+
+#define LISTENING  0 // receiving, rate not confirmed yet
+#define LOCKED     1 // receiving, rate confirmed
+#define MEASURING  2 // Serial1 off, measuring pulse widths
+
+// frames to see before taking a rate as confirmed, and for watching it after
+#define CHECK_FRAMES    16
+// misframes within CHECK_FRAMES frames that make us measure again
+#define MAX_MISFRAMES   4
+// pulse width edges to see before picking a rate
+#define MEASURE_EDGES   40
+// ms to wait for them, the mouse only sends while moved
+#define MEASURE_TIMEOUT 1000
+
+static volatile uint16_t minWidth;
+static volatile uint8_t edges;
+static volatile unsigned long lastEdge;
+
+/*
+    Pin change interrupt, keeps the shortest time between two edges. Pulses
+    much shorter than a bit at the highest rate are glitches.
+ */
+static void onEdge() {
+    unsigned long now = micros();
+    unsigned long width = now - lastEdge;
+    lastEdge = now;
+    if (edges < 0xFF) {
+        edges++;
+    }
+    if (edges > 1 && width < minWidth && width > 1000000UL / 19200 * 3 / 4) {
+        minWidth = width;
+    }
+}
+
+MouseBaud::MouseBaud() : state(LISTENING), rateIx(0), failed(0), frames(0),
+    misframes(0), since(0) {}
+
+/*
+    Start listening at the configured rate.
+ */
+void MouseBaud::begin() {
+    uint8_t ix = 0;
+    for (uint8_t i = 0; i < array_len(rates); i++) {
+        if (pgm_read_word(&rates[i]) == MOUSE_BAUD) {
+            ix = i;
+        }
+    }
+    listen(ix);
+}
+
+/*
+    Watch how well we're doing with the current rate, call from main loop.
+ */
+void MouseBaud::tick() {
+
+    switch (state) {
+
+        case MEASURING:
+            if (edges >= MEASURE_EDGES) {
+                detachInterrupt(digitalPinToInterrupt(MOUSE_RX_PIN));
+                listen(pick(minWidth));
+            } else if (millis() - since > MEASURE_TIMEOUT) {
+                // mouse not moved, rather listen again than not at all
+                DPRINTLN("MouseBaud.tick: no pulses");
+                detachInterrupt(digitalPinToInterrupt(MOUSE_RX_PIN));
+                listen(rateIx);
+            }
+            return;
+
+        default:
+            // until the protocol is known, frames may get cut in half, which
+            // says nothing about the rate
+            if (!mouseConverter.isDetected()) {
+                snapshot();
+                return;
+            }
+            if (mouseSync.misframes - misframes >= MAX_MISFRAMES) {
+                DPRINTLN("MouseBaud.tick: no frames at " + String(rate()));
+                if (state == LISTENING) {
+                    failed |= 1 << rateIx;
+                }
+                measure();
+            } else if (mouseSync.frames - frames >= CHECK_FRAMES) {
+                if (state == LISTENING) {
+                    DPRINTLN("MouseBaud.tick: rate " + String(rate()) +
+                        " confirmed");
+                    state = LOCKED;
+                    failed = 0;
+                }
+                snapshot();
+            }
+    }
+}
+
+uint32_t MouseBaud::rate() {
+    return pgm_read_word(&rates[rateIx]);
+}
+
+void MouseBaud::listen(uint8_t ix) {
+    rateIx = ix;
+    state = LISTENING;
+    mouseConverter.redetect();
+    snapshot();
+    DPRINTLN("MouseBaud.listen: " + String(rate()));
+    Serial1.begin(rate(), SERIAL_8N2);
+}
+
+void MouseBaud::measure() {
+    Serial1.end();
+    state = MEASURING;
+    since = millis();
+    minWidth = 0xFFFF;
+    edges = 0;
+    attachInterrupt(digitalPinToInterrupt(MOUSE_RX_PIN), onEdge, CHANGE);
+}
+
+/*
+    Pick the candidate rate with bit width closest to width, skipping the
+    ones that failed.
+ */
+uint8_t MouseBaud::pick(uint16_t width) {
+
+    if (failed == (1 << array_len(rates)) - 1) {
+        failed = 0;
+    }
+
+    uint8_t best = 0;
+    uint16_t bestDiff = 0xFFFF;
+    for (uint8_t i = 0; i < array_len(rates); i++) {
+        if (failed & (1 << i)) {
+            continue;
+        }
+        uint16_t bit = 1000000UL / pgm_read_word(&rates[i]);
+        uint16_t diff = width > bit ? width - bit : bit - width;
+        if (diff < bestDiff) {
+            best = i;
+            bestDiff = diff;
+        }
+    }
+
+    DPRINTLN("MouseBaud.pick: bit width " + String(width) + "us");
+    return best;
+}
+
+void MouseBaud::snapshot() {
+    frames = mouseSync.frames;
+    misframes = mouseSync.misframes;
+}
+
+MouseBaud mouseBaud;
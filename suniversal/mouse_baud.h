@@ -0,0 +1,70 @@
+/*
+    mouse_baud - detecting the baud rate of the mouse
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOUSE_BAUD_h
+#define MOUSE_BAUD_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+// RX pin of Serial1 on the Pro Micro, which is also INT2
+#define MOUSE_RX_PIN 0
+
+/*
+    Listens to the mouse at MOUSE_BAUD first, and checks that this gives
+    proper frames. When it doesn't, i.e. the mouse converter keeps losing
+    sync (see MouseSync in mouse.h), Serial1 is turned off, and the width
+    of the shortest pulse on the RX pin is measured with a pin change
+    interrupt. That's the width of a single bit, from which we pick the
+    closest of the candidate rates, and listen again. A rate that fails
+    again is not picked until all others have failed too. If the mouse
+    isn't moved while measuring, we go back to the rate we had. Misframes
+    only count once the mouse protocol is detected, since a 5-byte mouse
+    loses half its first frame before that.
+
+    Nothing gets lost with a standard mouse. With a faster one, the first
+    few frames are used up for measuring. Either way, the detected rate is
+    used until frames break again, e.g. when another mouse is plugged in.
+ */
+class MouseBaud {
+
+private:
+    uint8_t state;
+    uint8_t rateIx;
+    uint8_t failed;      // bit n is set if candidate rate n failed
+    uint16_t frames;     // mouse sync counters when we last checked
+    uint16_t misframes;
+    unsigned long since; // when measuring started
+    void listen(uint8_t ix);
+    void measure();
+    uint8_t pick(uint16_t width);
+    void snapshot();
+
+public:
+    MouseBaud();
+    void begin();
+    void tick();
+    uint32_t rate();
+};
+
+extern MouseBaud mouseBaud;
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    mouse_keys - moving the mouse pointer with keys
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "mouse_keys.h"
+#include "usb_mouse.h"
+
+#define SPEED_MIN   MK_SPEED(MOUSE_KEYS_SPEED_MIN)
+#define SPEED_MAX   MK_SPEED(MOUSE_KEYS_SPEED_MAX)
+#define SPEED_STEP  ((SPEED_MAX - SPEED_MIN) / MOUSE_KEYS_ACCEL_TIME + 1)
+
+static_assert(MK_BUTTON_LEFT >> 4 == MOUSE_LEFT &&
+    MK_BUTTON_RIGHT >> 4 == MOUSE_RIGHT &&
+    MK_BUTTON_MIDDLE >> 4 == MOUSE_MIDDLE,
+    "mouse key buttons need to match USB mouse buttons");
+static_assert(SPEED_MIN > 0 && SPEED_MIN <= SPEED_MAX,
+    "check mouse keys speeds");
+// rest plus a step's worth of motion must fit into 16 bits
+static_assert(SPEED_MAX < 0x7FFF - (1 << MK_FRACTION_BITS),
+    "MOUSE_KEYS_SPEED_MAX too high");
+
+MouseKeys::MouseKeys() :
+    state(0),
+    speed(0),
+    restX(0),
+    restY(0),
+    lastStep(0)
+{
+    memset(counts, 0, sizeof(counts));
+}
+
+/*
+    A mouse key went down or up. Several keys may hold the same direction
+    or button, so we count.
+ */
+void MouseKeys::update(uint8_t bits, bool pressed) {
+    // motion starts from here, also when step wasn't called while resting
+    if (!moving()) {
+        lastStep = millis();
+    }
+    for (uint8_t i = 0; i < sizeof(counts); i++) {
+        if (bits & (1 << i)) {
+            if (pressed) {
+                counts[i]++;
+            } else if (counts[i] > 0) {
+                counts[i]--;
+            }
+            if (counts[i] > 0) {
+                state |= 1 << i;
+            } else {
+                state &= ~(1 << i);
+            }
+        }
+    }
+    DPRINTLN("MouseKeys.update: " + String(state, HEX));
+}
+
+/*
+    Release everything, for when all keys have been released.
+ */
+void MouseKeys::releaseAll() {
+    memset(counts, 0, sizeof(counts));
+    state = 0;
+}
+
+/*
+    Buttons held with mouse keys, as USB mouse button mask.
+ */
+uint8_t MouseKeys::buttons() {
+    return state >> 4;
+}
+
+/*
+    Whether any direction is held, i.e. step has something to do.
+ */
+bool MouseKeys::moving() {
+    return (state & (MK_UP | MK_DOWN | MK_LEFT | MK_RIGHT)) != 0;
+}
+
+/*
+    Advance motion for the milliseconds passed since the last call. Returns
+    true if there's movement to send. Call from main loop.
+ */
+bool MouseKeys::step(int8_t& dx, int8_t& dy) {
+
+    unsigned long now = millis();
+    unsigned long steps = now - lastStep;
+    if (steps == 0) {
+        return false;
+    }
+    lastStep = now;
+
+    int8_t x = ((state & MK_RIGHT) ? 1 : 0) - ((state & MK_LEFT) ? 1 : 0);
+    int8_t y = ((state & MK_DOWN) ? 1 : 0) - ((state & MK_UP) ? 1 : 0);
+    if (x == 0 && y == 0) {
+        speed = 0;
+        restX = 0;
+        restY = 0;
+        return false;
+    }
+
+    if (steps > MK_MAX_STEPS) {
+        steps = MK_MAX_STEPS;
+    }
+
+    int16_t outX = 0;
+    int16_t outY = 0;
+
+    for (uint8_t i = 0; i < steps; i++) {
+        speed = speed == 0 ? SPEED_MIN :
+            (speed < SPEED_MAX - SPEED_STEP ? speed + SPEED_STEP : SPEED_MAX);
+        // 181 / 256 ~ 1 / sqrt(2)
+        uint16_t s = x != 0 && y != 0 ? ((uint32_t)speed * 181) >> 8 : speed;
+        restX += x * (int16_t)s;
+        restY += y * (int16_t)s;
+        // whole pixels, rounded towards zero
+        int16_t px = restX / (1 << MK_FRACTION_BITS);
+        int16_t py = restY / (1 << MK_FRACTION_BITS);
+        restX -= px * (1 << MK_FRACTION_BITS);
+        restY -= py * (1 << MK_FRACTION_BITS);
+        outX += px;
+        outY += py;
+    }
+
+    dx = constrain(outX, -127, 127);
+    dy = constrain(outY, -127, 127);
+    return dx != 0 || dy != 0;
+}
+
+MouseKeys mouseKeys;
@@ -0,0 +1,78 @@
+/*
+    mouse_keys - moving the mouse pointer with keys
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOUSE_KEYS_h
+#define MOUSE_KEYS_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+/*
+    Mouse keys have MOUSE_KEY(bits) assigned in the keymap (see layers.h),
+    where bits are any of the directions and buttons below. A key can have
+    several directions, e.g. MK_UP | MK_LEFT for a diagonal.
+ */
+#define MK_UP            0x01
+#define MK_DOWN          0x02
+#define MK_LEFT          0x04
+#define MK_RIGHT         0x08
+#define MK_BUTTON_LEFT   0x10
+#define MK_BUTTON_RIGHT  0x20
+#define MK_BUTTON_MIDDLE 0x40
+
+/*
+    Speeds are kept as fixed point numbers, in 1/4096 pixel per millisecond.
+    While any direction key is down, the pointer starts moving at
+    MOUSE_KEYS_SPEED_MIN, and speeds up linearly to MOUSE_KEYS_SPEED_MAX
+    within MOUSE_KEYS_ACCEL_TIME (see config.h). Motion is integrated once
+    per millisecond, i.e. at the rate the host polls the mouse, and the
+    fractions of pixels are carried over, so the pointer moves smoothly
+    even at low speeds. Diagonals are scaled by 1/sqrt(2).
+ */
+#define MK_FRACTION_BITS 12
+#define MK_SPEED(pxPerSec) \
+    ((uint16_t)(((uint32_t)(pxPerSec) << MK_FRACTION_BITS) / 1000))
+
+// max number of milliseconds to catch up with when the loop was late
+#define MK_MAX_STEPS 8
+
+class MouseKeys {
+
+private:
+    uint8_t counts[7];  // how many keys hold each direction & button
+    uint8_t state;      // directions & buttons that are held
+    uint16_t speed;
+    int16_t restX;      // fractions of pixels not sent yet
+    int16_t restY;
+    unsigned long lastStep;
+
+public:
+    MouseKeys();
+    void update(uint8_t bits, bool pressed);
+    void releaseAll();
+    uint8_t buttons();
+    bool moving();
+    bool step(int8_t& dx, int8_t& dy);
+};
+
+extern MouseKeys mouseKeys;
+
+#endif
@@ -0,0 +1,103 @@
+/*
+    pipeline - compile time composition of input processing stages
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIPELINE_h
+#define PIPELINE_h
+
+#include <stdint.h>
+
+/*
+    Keyboard and mouse input each pass through a chain of stages. A stage is
+    a class template that takes the next stage as its parameter, and only has
+    static members, so the whole chain is resolved by the compiler and each
+    stage can be inlined into its predecessor.
+
+    Keyboard stages see two kinds of events:
+
+     - handleKey(key, pressed) carries SUN scan codes, and is what comes in
+       from the keyboard
+     - handleCode(code, pressed) carries 16 bit codes as described in
+       sun_to_usb.h, i.e. USB scan codes, modifiers, and macro IDs
+
+    A translating stage turns the former into the latter. Stages before it
+    may also inject codes directly with handleCode, which stages in between
+    simply pass on. Additionally, tick() gets called once per loop for
+    stages that need to do things over time, and reset() when all keys
+    are released at once, e.g. on an idle code from the keyboard, so
+    stages drop whatever they're holding back or waiting for. busy() tells
+    whether any stage has something coming up in tick(), e.g. a timeout,
+    for callers that don't need to tick otherwise.
+
+    Mouse stages see button changes, movements, and scroll events, all in USB
+    HID convention, i.e. buttons high active, positive dy is down.
+
+    The base templates below just forward everything. A concrete stage
+    derives from one of them and hides the functions it wants to act on.
+ */
+template <class Next>
+struct KeyStage {
+    static inline void handleKey(uint8_t key, bool pressed) {
+        Next::handleKey(key, pressed);
+    }
+    static inline void handleCode(uint16_t code, bool pressed) {
+        Next::handleCode(code, pressed);
+    }
+    static inline void tick() {
+        Next::tick();
+    }
+    static inline void reset() {
+        Next::reset();
+    }
+    static inline bool busy() {
+        return Next::busy();
+    }
+};
+
+template <class Next>
+struct MouseStage {
+    static inline void handleButtons(uint8_t buttons) {
+        Next::handleButtons(buttons);
+    }
+    static inline void handleMove(int8_t dx, int8_t dy) {
+        Next::handleMove(dx, dy);
+    }
+    static inline void handleScroll(int8_t v, int8_t h) {
+        Next::handleScroll(v, h);
+    }
+    static inline void tick() {
+        Next::tick();
+    }
+    static inline bool busy() {
+        return Next::busy();
+    }
+};
+
+/*
+    Use<enabled, S, Next> is stage S<Next> if enabled, otherwise just Next.
+    This is how the feature switches in config.h select stages, so disabled
+    features don't end up in the binary at all.
+ */
+template <bool enabled, template <class> class S, class Next>
+struct Use : S<Next> {};
+
+template <template <class> class S, class Next>
+struct Use<false, S, Next> : Next {};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+    power - USB suspend & remote wakeup
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+
+#include "config.h"
+#include "power.h"
+#include "usb_keyboard.h"
+
+// ms after which we give up on the host resuming after a wakeup, e.g. when
+// it has remote wakeup disabled; keeps the latency within 16 bits
+#define WAKE_TIMEOUT 10000
+
+Power::Power() : suspended(false), waking(false), wokeAt(0), lastIdle(0) {}
+
+/*
+    Check whether the host has suspended us, call from main loop. Returns
+    true while suspended.
+ */
+bool Power::update() {
+
+    if (waking && millis() - wokeAt > WAKE_TIMEOUT) {
+        DPRINTLN("Power.update: host didn't wake up");
+        waking = false;
+    }
+
+    bool s = USBDevice.isSuspended();
+    if (s == suspended) {
+        return s;
+    }
+
+    suspended = s;
+    if (s) {
+        DPRINTLN("Power.update: suspended");
+        powerStats.suspends++;
+        lastIdle = micros();
+    } else {
+        DPRINTLN("Power.update: resumed");
+        if (waking) {
+            uint16_t latency = millis() - wokeAt;
+            powerStats.wakeLatency = latency;
+            if (latency > powerStats.maxWakeLatency) {
+                powerStats.maxWakeLatency = latency;
+            }
+            waking = false;
+        }
+    }
+    return s;
+}
+
+/*
+    Wake up the host. This only works if the host has enabled remote wakeup,
+    but there's no harm in trying again.
+ */
+void Power::wakeup() {
+    if (!waking) {
+        waking = true;
+        wokeAt = millis();
+        powerStats.wakeups++;
+    }
+    usbKeyboard.wakeupHost();
+}
+
+/*
+    Sleep until the next interrupt. Idle mode keeps timers, USART, USB, and
+    pin change interrupts running, so we see keys, mouse, and resume right
+    away. Timer 0 wakes us up every millisecond at the latest.
+ */
+void Power::idle() {
+
+    unsigned long start = micros();
+    powerStats.awake += (start - lastIdle) >> 4;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_mode();
+
+    lastIdle = micros();
+    powerStats.asleep += (lastIdle - start) >> 4;
+
+    if ((powerStats.awake | powerStats.asleep) & 0x80000000) {
+        powerStats.awake >>= 1;
+        powerStats.asleep >>= 1;
+    }
+}
+
+PowerStats powerStats;
+Power power;
@@ -0,0 +1,80 @@
+/*
+    power - USB suspend & remote wakeup
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POWER_h
+#define POWER_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+/*
+    What happened while the host had us suspended:
+
+     - suspends:       number of times we got suspended
+     - wakeups:        number of times we woke up the host
+     - wakeLatency:    ms from waking up the host to it resuming the bus,
+                       i.e. until reports can be sent again, last time;
+                       a wakeup the host ignores for 10s isn't counted
+     - maxWakeLatency: longest of those
+     - awake, asleep:  time the CPU ran and slept while suspended, in units
+                       of 16us; both get halved when they grow large, so
+                       only the ratio is meaningful, which is what the
+                       current draw while suspended depends on
+ */
+struct PowerStats {
+    uint16_t suspends;
+    uint16_t wakeups;
+    uint16_t wakeLatency;
+    uint16_t maxWakeLatency;
+    uint32_t awake;
+    uint32_t asleep;
+};
+
+extern PowerStats powerStats;
+
+/*
+    Tracks USB suspend. While suspended, nothing is sent to the host, the
+    keyboard LEDs are off, and the main loop sleeps between interrupts. Any
+    key or mouse button wakes up the host, and is then dropped, so it
+    doesn't end up typed or clicked.
+ */
+class Power {
+
+private:
+    bool suspended;
+    bool waking;
+    unsigned long wokeAt;
+    unsigned long lastIdle; // micros() when we last came out of sleep
+
+public:
+    Power();
+    bool update();
+    void wakeup();
+    void idle();
+
+    inline bool isSuspended() {
+        return suspended;
+    }
+};
+
+extern Power power;
+
+#endif
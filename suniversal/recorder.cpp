@@ -0,0 +1,292 @@
+/*
+    recorder - record key sequences on the keyboard, and play them back
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "config.h"
+#include "keymap.h"
+#include "recorder.h"
+#include "sun_codes.h"
+
+// page header
+#define PAGE_ADDRESS(p) (RECORDER_EEPROM_START + (p) * RECORDER_PAGE_SIZE)
+#define HDR_SLOT   0
+#define HDR_SEQ    1
+#define HDR_LENGTH 3
+#define HDR_SIZE   4
+
+#define NONE 0xFF
+
+static_assert(RECORDER_EEPROM_START >=
+    KEYMAP_EEPROM_START + 2 * (1 + sizeof(KeymapReport)),
+    "recorder overlaps user keymap in EEPROM");
+static_assert(PAGE_ADDRESS(RECORDER_PAGES) <= 1024,
+    "recorder pages don't fit into EEPROM");
+static_assert(RECORDER_PAGES > RECORDER_SLOTS,
+    "need at least one spare page");
+
+Recorder::Recorder() :
+    length(0),
+    mark(0),
+    downCount(0),
+    held(0),
+    recording(-1),
+    lastPage(RECORDER_PAGES - 1),
+    seq(0),
+    playPage(NONE)
+{
+    memset(pages, NONE, sizeof(pages));
+}
+
+/*
+    Find the latest recording of each slot in EEPROM.
+ */
+void Recorder::begin() {
+
+    bool first = true;
+
+    for (uint8_t p = 0; p < RECORDER_PAGES; p++) {
+
+        uint8_t slot = EEPROM.read(PAGE_ADDRESS(p) + HDR_SLOT);
+        if (slot >= RECORDER_SLOTS) {
+            continue;
+        }
+
+        uint16_t s;
+        EEPROM.get(PAGE_ADDRESS(p) + HDR_SEQ, s);
+
+        if (pages[slot] == NONE) {
+            pages[slot] = p;
+        } else {
+            uint16_t other;
+            EEPROM.get(PAGE_ADDRESS(pages[slot]) + HDR_SEQ, other);
+            if ((int16_t)(s - other) > 0) {
+                pages[slot] = p;
+            }
+        }
+
+        if (first || (int16_t)(s - seq) >= 0) {
+            seq = s + 1;
+            lastPage = p;
+            first = false;
+        }
+    }
+}
+
+/*
+    Start recording into slot, or stop if already recording. Recording
+    another slot stops that one first.
+ */
+void Recorder::toggle(uint8_t slot) {
+
+    if (slot >= RECORDER_SLOTS || playPage != NONE) {
+        return;
+    }
+
+    if (recording >= 0) {
+        bool same = recording == slot;
+        save();
+        if (same) {
+            return;
+        }
+    }
+
+    DPRINTLN("Recorder.toggle: recording slot " + String(slot));
+    recording = slot;
+    length = 0;
+    mark = 0;
+    downCount = 0;
+    memset(down, 0, sizeof(down));
+    lastAt = millis();
+}
+
+/*
+    Play slot. Playback starts once all keys are up, so a layer key that's
+    still held doesn't change what's played.
+ */
+void Recorder::play(uint8_t slot) {
+    if (slot >= RECORDER_SLOTS || recording >= 0 || playPage != NONE ||
+        pages[slot] == NONE) {
+        return;
+    }
+    DPRINTLN("Recorder.play: slot " + String(slot));
+    playPage = pages[slot];
+    playPos = 0;
+    playEnd = EEPROM.read(PAGE_ADDRESS(playPage) + HDR_LENGTH);
+    lastAt = millis();
+}
+
+/*
+    Gets called for every key event. While recording, releases of keys that
+    went down before recording started are left out, so the recording only
+    has complete key strokes.
+ */
+void Recorder::record(uint8_t key, bool pressed) {
+
+    if (pressed) {
+        held++;
+    } else if (held > 0) {
+        held--;
+    }
+
+    if (recording < 0 || (!pressed && !isDown(key))) {
+        return;
+    }
+
+    unsigned long now = millis();
+    unsigned long delta = now - lastAt;
+    if (delta > 0x7FFF) {
+        delta = 0x7FFF;
+    }
+
+    if (length + (delta < 0x80 ? 2 : 3) > RECORDER_MAX_BYTES) {
+        DPRINTLN("Recorder.record: full");
+        save();
+        return;
+    }
+
+    lastAt = now;
+    buffer[length++] = pressed ? key : key | BREAK_BIT;
+    if (delta < 0x80) {
+        buffer[length++] = delta;
+    } else {
+        buffer[length++] = 0x80 | (delta >> 8);
+        buffer[length++] = delta & 0xFF;
+    }
+
+    setDown(key, pressed);
+    if (downCount == 0) {
+        mark = length;
+    }
+}
+
+/*
+    All keys are up.
+ */
+void Recorder::releaseAll() {
+    held = 0;
+}
+
+bool Recorder::playing() {
+    return playPage != NONE;
+}
+
+bool Recorder::isRecording() {
+    return recording >= 0;
+}
+
+/*
+    Get next event to play. Returns false if there is nothing to play right
+    now. With RECORDER_TEMPO, events are due at the times they were
+    recorded, otherwise right away.
+ */
+bool Recorder::next(uint8_t& key, bool& pressed) {
+
+    if (playPage == NONE || held > 0) {
+        return false;
+    }
+
+    if (playPos >= playEnd) {
+        playPage = NONE;
+        return false;
+    }
+
+    uint16_t addr = PAGE_ADDRESS(playPage) + HDR_SIZE + playPos;
+    uint8_t k = EEPROM.read(addr);
+    uint16_t delta = EEPROM.read(addr + 1);
+    uint8_t size = 2;
+    if (delta & 0x80) {
+        delta = (delta & 0x7F) << 8 | EEPROM.read(addr + 2);
+        size = 3;
+    }
+
+#if RECORDER_TEMPO == true
+    unsigned long now = millis();
+    if (playPos > 0 && now - lastAt < delta) {
+        return false;
+    }
+    lastAt = now;
+#endif
+
+    playPos += size;
+    key = k & ~BREAK_BIT;
+    pressed = (k & BREAK_BIT) == 0;
+    return true;
+}
+
+bool Recorder::isDown(uint8_t key) {
+    return down[key >> 3] & (1 << (key & 0x07));
+}
+
+void Recorder::setDown(uint8_t key, bool pressed) {
+    if (pressed && !isDown(key)) {
+        down[key >> 3] |= 1 << (key & 0x07);
+        downCount++;
+    } else if (!pressed && isDown(key)) {
+        down[key >> 3] &= ~(1 << (key & 0x07));
+        downCount--;
+    }
+}
+
+/*
+    Stop recording, and store what was recorded up to the last point where
+    all recorded keys were up. That leaves out the keys that stopped the
+    recording. Nothing gets stored if nothing was recorded.
+ */
+void Recorder::save() {
+
+    uint8_t slot = recording;
+    recording = -1;
+
+    if (mark == 0) {
+        DPRINTLN("Recorder.save: nothing recorded");
+        return;
+    }
+
+    // next page that doesn't hold the recording of any slot
+    uint8_t p = lastPage;
+    bool used;
+    do {
+        p = (p + 1) % RECORDER_PAGES;
+        used = false;
+        for (uint8_t s = 0; s < RECORDER_SLOTS; s++) {
+            used |= pages[s] == p;
+        }
+    } while (used);
+
+    DPRINTLN("Recorder.save: slot " + String(slot) + ", " + String(mark) +
+        " bytes to page " + String(p));
+
+    uint16_t addr = PAGE_ADDRESS(p);
+    EEPROM.update(addr + HDR_SLOT, NONE);
+    for (uint8_t i = 0; i < mark; i++) {
+        EEPROM.update(addr + HDR_SIZE + i, buffer[i]);
+    }
+    EEPROM.update(addr + HDR_LENGTH, mark);
+    EEPROM.put(addr + HDR_SEQ, seq);
+    EEPROM.update(addr + HDR_SLOT, slot);
+
+    pages[slot] = p;
+    lastPage = p;
+    seq++;
+}
+
+Recorder recorder;
@@ -0,0 +1,85 @@
+/*
+    recorder - record key sequences on the keyboard, and play them back
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_h
+#define RECORDER_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+// number of recordings that can be kept
+#define RECORDER_SLOTS        4
+
+/*
+    Recordings are stored in EEPROM pages, after the user keymap. Each page
+    has a header (slot, sequence number, length), followed by the recorded
+    events. An event is the SUN scan code with the break bit set for
+    releases, followed by the time since the previous event in ms, in one
+    byte if below 128, otherwise in two bytes with the top bit set in the
+    first one (max. 32767ms).
+
+    A new recording never overwrites the page holding the current recording
+    of a slot, but goes into the next free page, round robin. That spreads
+    the writes over all pages, and if power is lost while storing, the
+    previous recording of the slot is still there. The page's slot number
+    is written last, so an incomplete page doesn't count.
+ */
+#define RECORDER_EEPROM_START 128
+#define RECORDER_PAGE_SIZE    128
+#define RECORDER_PAGES        7
+#define RECORDER_MAX_BYTES    (RECORDER_PAGE_SIZE - 4)
+
+class Recorder {
+
+private:
+    uint8_t buffer[RECORDER_MAX_BYTES];
+    uint8_t length;         // bytes recorded
+    uint8_t mark;           // length when last no recorded key was down
+    uint8_t down[16];       // recorded keys that are down, one bit each
+    uint8_t downCount;
+    uint8_t held;           // number of keys down on the keyboard
+    int8_t recording;       // slot being recorded, -1 if none
+    unsigned long lastAt;   // time of last recorded or played event
+    uint8_t pages[RECORDER_SLOTS]; // page of each slot, 0xFF if empty
+    uint8_t lastPage;       // page written last
+    uint16_t seq;           // sequence number for next page written
+    uint8_t playPage;       // page being played, 0xFF if none
+    uint8_t playPos;
+    uint8_t playEnd;
+    bool isDown(uint8_t key);
+    void setDown(uint8_t key, bool pressed);
+    void save();
+
+public:
+    Recorder();
+    void begin();
+    void toggle(uint8_t slot);
+    void play(uint8_t slot);
+    void record(uint8_t key, bool pressed);
+    void releaseAll();
+    bool playing();
+    bool isRecording();
+    bool next(uint8_t& key, bool& pressed);
+};
+
+extern Recorder recorder;
+
+#endif
@@ -0,0 +1,98 @@
+/*
+    sram - SRAM usage profiler
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#if PROFILE_SRAM == true
+
+#include "sram.h"
+
+// from avr-libc: start of heap, i.e. end of static data, and end of heap,
+// which stays 0 until something is allocated
+extern uint8_t __heap_start;
+extern uint8_t* __brkval;
+
+/*
+    Runs in .init3, i.e. after the stack pointer has been set up, but
+    before static data gets initialized and anything is on the stack. It
+    is not called, but falls through into the next init section, hence
+    naked. Static data is left alone, painting starts right above it.
+ */
+void sramPaint() __attribute__((naked, used, section(".init3")));
+
+void sramPaint() {
+    for (uint8_t* p = &__heap_start; p <= (uint8_t*)RAMEND; p++) {
+        *p = SRAM_PAINT;
+    }
+}
+
+/*
+
+ */
+SramProfiler::SramProfiler() : heapEnd(&__heap_start) {
+    sramStats.data = &__heap_start - (uint8_t*)RAMSTART;
+}
+
+/*
+    Call from the main loop with the number of bytes waiting from the
+    keyboard, right before reading them, and whether its RX buffer has
+    overflown since the last call.
+ */
+void SramProfiler::update(int keyboardRx, bool overflow) {
+    uint8_t* end = __brkval;
+    if (end > heapEnd) {
+        heapEnd = end;
+        sramStats.heap = end - &__heap_start;
+    }
+    if (keyboardRx > sramStats.keyboardRx) {
+        sramStats.keyboardRx = keyboardRx;
+    }
+    if (overflow) {
+        sramStats.keyboardOverflows++;
+    }
+}
+
+/*
+    Call with the number of bytes waiting on Serial1, right before reading
+    them.
+ */
+void SramProfiler::serialRx(int waiting) {
+    if (waiting > sramStats.serialRx) {
+        sramStats.serialRx = waiting;
+    }
+}
+
+/*
+    Finds the deepest point the stack has reached.
+ */
+void SramProfiler::scan() {
+    uint8_t* sp = (uint8_t*)SP;
+    uint8_t* p = heapEnd;
+    while (p < sp && *p == SRAM_PAINT) {
+        p++;
+    }
+    sramStats.stack = (uint8_t*)RAMEND + 1 - p;
+    sramStats.free = p - heapEnd;
+}
+
+SramStats sramStats;
+SramProfiler sramProfiler;
+
+#endif
@@ -0,0 +1,93 @@
+/*
+    sram - SRAM usage profiler
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SRAM_h
+#define SRAM_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+// what unused SRAM gets filled with at start up
+#define SRAM_PAINT 0xc5
+
+/*
+    How much of the 2.5KB SRAM we use, in bytes:
+
+     - data:       static data, i.e. .data and .bss, incl. all RAM tables
+                   and serial buffers
+     - heap:       most heap ever in use; only debug builds allocate
+     - stack:      deepest the stack ever went
+     - free:       least space there ever was between heap and stack; when
+                   this reaches 0, they have collided
+     - keyboardRx: most bytes ever waiting in the SoftwareSerial RX buffer
+     - serialRx:   most bytes ever waiting in the Serial1 RX buffer, i.e.
+                   from the mouse or the second keyboard
+
+    and keyboardOverflows, how often the SoftwareSerial RX buffer was found
+    to have overflown, i.e. bytes from the keyboard were lost.
+
+    stack and free are only brought up to date by SramProfiler::scan. Both
+    RX buffers hold 63 bytes, so when they get close to that, bytes are
+    about to get lost.
+ */
+struct SramStats {
+    uint16_t data;
+    uint16_t heap;
+    uint16_t stack;
+    uint16_t free;
+    uint8_t keyboardRx;
+    uint8_t serialRx;
+    uint16_t keyboardOverflows;
+};
+
+extern SramStats sramStats;
+
+/*
+    All SRAM between static data and stack gets painted with SRAM_PAINT
+    right at start up, before any constructors run. The stack overwrites
+    the paint as it grows, so the first byte above the heap that is not
+    paint anymore marks the deepest the stack has been. Stack data that
+    happens to equal SRAM_PAINT can make this off by a few bytes.
+
+    Finding that byte means walking through the free SRAM, so that's only
+    done in scan, when the numbers are wanted. update is cheap, and called
+    from the main loop for tracking heap size and RX buffers.
+
+    The heap end is only sampled in update, i.e. once per loop. Heap that's
+    allocated and freed again in between, such as the String temporaries
+    of DPRINT, is missed, so heap comes out too low, and scan counts what
+    was left there as stack.
+ */
+class SramProfiler {
+
+private:
+    uint8_t* heapEnd; // highest heap end seen
+
+public:
+    SramProfiler();
+    void update(int keyboardRx, bool overflow);
+    void serialRx(int waiting);
+    void scan();
+};
+
+extern SramProfiler sramProfiler;
+
+#endif
@@ -0,0 +1,42 @@
+/*
+    SUN keyboard command & report codes, and scan codes of special keys
+
+    as per SPARC keyboard specification:
+        http://sparc.org/wp-content/uploads/2014/01/KBD.pdf.gz
+ */
+
+#ifndef SUN_CODES_h
+#define SUN_CODES_h
+
+// SUN power key
+#define POWER            0x30
+
+// SUN toggle keys
+#define NUM_LOCK         0x62
+#define NUM_LOCK_MASK    0x01
+#define COMPOSE          0x43
+#define COMPOSE_MASK     0x02
+#define SCROLL_LOCK      0x17
+#define SCROLL_LOCK_MASK 0x04
+#define CAPS_LOCK        0x77
+#define CAPS_LOCK_MASK   0x08
+#define ALL_LEDS         0x0F
+
+// SUN keyboard command codes
+#define CMD_RESET        0x01
+#define CMD_BELL_ON      0x02
+#define CMD_BELL_OFF     0x03
+#define CMD_CLICK_ON     0x0A
+#define CMD_CLICK_OFF    0x0B
+#define CMD_LED          0x0E
+#define CMD_LAYOUT       0x0F
+
+// SUN keyboard report codes
+#define KBD_IDLE         0x7F
+#define KBD_LAYOUT_RESP  0xFE
+#define KBD_RESET_RESP   0xFF
+
+// key break bit is bit 7
+#define BREAK_BIT        0x80
+
+#endif
@@ -0,0 +1,345 @@
+/*
+    sun_port - a port with a SUN keyboard attached
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "irq_audit.h"
+#include "keyboard.h"
+#include "sun_codes.h"
+#include "sun_port.h"
+
+// ms to wait for a response, the self test after a reset takes the longest
+#define RESPONSE_TIMEOUT 2000
+
+// implemented in suniversal.ino
+void resetKeyboard();
+
+SunPort::SunPort(Stream& link) : link(link), broken(false), absent(false),
+    next(this) {
+    cmdLED[0] = CMD_LED;
+    cmdLED[1] = 0x00;
+    memset(held, 0, sizeof(held));
+}
+
+/*
+    Add other port to the ports this one shares keys with.
+ */
+void SunPort::join(SunPort& other) {
+    other.next = next;
+    next = &other;
+}
+
+/*
+    From keyboard documentation: After receiving the reset command, the
+    keyboard executes the self test routine. The keyboard responds with:
+    0FFH, 004H, 007FH if the self test passes and no keys are down. The
+    code 07FH is replaced by the make code if a key is down. The keyboard
+    sends 07EH, 001H if the self test fails.
+ */
+void SunPort::reset() {
+
+    DPRINTLN("resetting keyboard");
+
+    // read anything that may have come in after power-up
+    clearFromBuffer(0);
+    link.write(CMD_RESET);
+
+    // if first byte is keyboard reset response, we consider that success
+    int response = waitAndRead();
+    if (response == KBD_RESET_RESP) {
+
+        DPRINTLN("keyboard ok");
+        broken = false;
+        absent = false;
+        // wait for & discard the remainder of the response
+        waitForResponse(2);
+        clearFromBuffer(2);
+
+        link.write(cmdLED, 2); // reset LEDs
+
+#if STARTUP_GREETING == true
+        flashLEDs(CAPS_LOCK_MASK);
+        flashLEDs(SCROLL_LOCK_MASK);
+        flashLEDs(NUM_LOCK_MASK);
+        flashLEDs(COMPOSE_MASK);
+        flashLEDs(ALL_LEDS);
+        beep(75);
+        beep(75);
+#endif
+
+    } else if (response < 0) {
+        // no keyboard, and no one to beep at; it's picked up in update once
+        // it's plugged in
+        DPRINTLN("no keyboard");
+        absent = true;
+
+    } else {
+        DPRINTLN("keyboard broken");
+        broken = true;
+        for (uint8_t i = 0; i < 8; i++) {
+            beep(125);
+        }
+    }
+}
+
+/*
+    Depending on the keyboard layout in use, some of the macros need to press
+    different keys. For example, if we want to send Ctrl-Z to the host for an
+    Undo, we send the scan codes for Control and Z. If the keyboard layout
+    however is for example German, the Z and Y keys will be swapped, and the
+    host will interpret the scan code for Z actually as a Y, and we end up with
+    Ctrl-Y (Redo). There's a macro table for each layout (see macros.cpp), and
+    the same goes for typing text.
+
+    Now there's no way of knowing what layout is active on the host, but in most
+    cases, it will be the same as is set in the keyboard itself. So we get the
+    layout from the keyboard here and pass it to the converter to select the
+    tables for it (see resetKeyboard). If this is not not desired, you can force
+    a particular layout with the FORCE_LAYOUT setting in config.h.
+ */
+uint8_t SunPort::getLayout() {
+
+    if (FORCE_LAYOUT != GET_FROM_KEYBOARD) {
+        DPRINTLN("using forced layout: " + String(FORCE_LAYOUT));
+        return FORCE_LAYOUT;
+    }
+
+    link.write(CMD_LAYOUT);
+
+    if (waitAndRead() != KBD_LAYOUT_RESP) {
+        DPRINTLN("could not determine keyboard layout, defaulting to US");
+        return UNITED_STATES;
+    }
+
+    // The Type 5 has 8 DIP switch, while on the Type 5c I have, there are only
+    // 5, corresponding to bits 4 through 8 of the layout code. Bit 3 is always
+    // 1, and bits 2 and 1 are 0 per documentation anyway. Therefore masking out
+    // bits 1,2 and 3. Works with both keyboards.
+    uint8_t l = waitAndRead() & 0x1F;
+
+    switch (l) {
+        case UNITED_STATES:
+        case FRENCH_BELGIUM:
+        case CANADA_FRENCH:
+        case DENMARK:
+        case GERMANY:
+        case ITALY:
+        case NETHERLANDS:
+        case NORWAY:
+        case PORTUGAL:
+        case SPAIN_LATIN_AMERICA:
+        case SWEDEN_FINLAND:
+        case SWISS_FRENCH:
+        case SWISS_GERMAN:
+        case UNITED_KINGDOM:
+            DPRINTLN("keyboard layout: " + String(l));
+            return l;
+    }
+
+    DPRINTLN("invalid keyboard layout: " + String(l) + ", defaulting to US");
+    return UNITED_STATES;
+}
+
+/*
+    Handle whatever came in from the keyboard, call from main loop. While
+    the port is absent, everything is dropped, until a keyboard that was
+    plugged in or powered up sends its self test result, which starts a
+    reset.
+ */
+void SunPort::update() {
+    while (link.available() > 0) {
+        int key = link.read();
+        if (key == -1) { // shouldn't really happen
+            continue;
+        }
+        if (absent) {
+            if (key == KBD_RESET_RESP) {
+                resetKeyboard();
+                return;
+            }
+            continue;
+        }
+        handleKey(key);
+    }
+}
+
+void SunPort::handleKey(uint8_t key) {
+    if (key == KBD_IDLE) {
+        DPRINTLN("suniversal: all released");
+        releaseAll();
+    } else {
+        bool pressed = (key & BREAK_BIT) == 0;
+        key &= (~BREAK_BIT); // mask out break bit
+        DPRINT("suniversal: " + String(key, HEX));
+        DPRINTLN(pressed ? " down" : " up");
+        bool elsewhere = isHeldElsewhere(key);
+        setHeld(key, pressed);
+        if (!elsewhere) {
+            keyboardConverter.handleKey(key, pressed);
+        }
+    }
+    DPRINTLN();
+}
+
+/*
+    All keys on this port are up. If that's true for all other ports too,
+    release everything, otherwise just the keys that were held here.
+ */
+void SunPort::releaseAll() {
+
+    bool others = false;
+    for (SunPort* p = next; p != this; p = p->next) {
+        others |= p->holdsAny();
+    }
+
+    if (others) {
+        for (uint8_t key = 0; key < 128; key++) {
+            if (isHeld(key) && !isHeldElsewhere(key)) {
+                keyboardConverter.handleKey(key, false);
+            }
+        }
+    } else {
+        keyboardConverter.releaseAll();
+    }
+
+    memset(held, 0, sizeof(held));
+}
+
+bool SunPort::isHeld(uint8_t key) {
+    return held[key >> 3] & (1 << (key & 0x07));
+}
+
+void SunPort::setHeld(uint8_t key, bool pressed) {
+    if (pressed) {
+        held[key >> 3] |= 1 << (key & 0x07);
+    } else {
+        held[key >> 3] &= ~(1 << (key & 0x07));
+    }
+}
+
+bool SunPort::isHeldElsewhere(uint8_t key) {
+    for (SunPort* p = next; p != this; p = p->next) {
+        if (p->isHeld(key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SunPort::holdsAny() {
+    for (uint8_t i = 0; i < sizeof(held); i++) {
+        if (held[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Set keyboard LEDs to leds (SUN LED bits), if they changed.
+ */
+void SunPort::updateLEDs(uint8_t leds) {
+    if (cmdLED[1] != leds) {
+        DPRINTLN("suniversal: LED state changed: " + String(cmdLED[1], HEX) +
+            " --> " + String(leds, HEX));
+        cmdLED[1] = leds;
+        sendLEDs();
+    }
+}
+
+uint8_t SunPort::getLEDs() {
+    return cmdLED[1];
+}
+
+void SunPort::toggleLEDs(uint8_t mask) {
+    cmdLED[1] ^= mask;
+    sendLEDs();
+}
+
+/*
+    Only SoftwareSerial keeps interrupts off while writing, Serial1 just
+    fills its TX buffer, so writes to the second keyboard aren't timed.
+ */
+void SunPort::sendLEDs() {
+#if PROFILE_IRQS == true
+    if (&link != &Serial1) {
+        IRQ_SECTION();
+        link.write(cmdLED, 2);
+        return;
+    }
+#endif
+    link.write(cmdLED, 2);
+}
+
+void SunPort::flashLEDs(uint8_t mask) {
+    toggleLEDs(mask);
+    delay(200);
+    toggleLEDs(mask);
+    delay(200);
+}
+
+void SunPort::beep(unsigned long duration) {
+    link.write(CMD_BELL_ON);
+    delay(duration);
+    link.write(CMD_BELL_OFF);
+    delay(duration);
+}
+
+/*
+    Clear `count` number of bytes from serial input buffer. Does not block if
+    there are less bytes present. If `count` is 0, clears all bytes present in
+    buffer. Returns number of bytes removed from buffer.
+ */
+uint8_t SunPort::clearFromBuffer(int8_t count) {
+    uint8_t i = 0;
+    for (; link.available() > 0; i++) {
+        if (count > 0 && i == count) {
+            return i;
+        }
+        link.read();
+    }
+    return i;
+}
+
+/*
+    Waits until at least `expected` number of bytes are available in the serial
+    input buffer, for RESPONSE_TIMEOUT at most, e.g. when there's no keyboard
+    on this port. Returns whether they came.
+ */
+bool SunPort::waitForResponse(uint8_t expected) {
+    unsigned long start = millis();
+    while (link.available() < expected) {
+        if (millis() - start > RESPONSE_TIMEOUT) {
+            DPRINTLN("no response from keyboard");
+            return false;
+        }
+        delay(50);
+    }
+    return true;
+}
+
+/*
+    Read a single byte form the serial connection. Wait if no byte is available.
+    Returns -1 if none came in time.
+ */
+int SunPort::waitAndRead() {
+    return waitForResponse(1) ? link.read() : -1;
+}
@@ -0,0 +1,76 @@
+/*
+    sun_port - a port with a SUN keyboard attached
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUN_PORT_h
+#define SUN_PORT_h
+
+#include <Arduino.h>
+
+#include "config.h"
+
+/*
+    A port with a SUN keyboard on it, talking over link, which can be a
+    software or hardware serial. Ports keep their own LED state and the keys
+    held on them, but feed the same keyboard converter, so all keyboards
+    show up as a single keyboard on the host. A key held on two keyboards
+    at once is pressed once, and released when the last one lets go of it.
+ */
+class SunPort {
+
+private:
+    Stream& link;
+    uint8_t cmdLED[2];
+    uint8_t held[16];   // bit set for each key held on this port
+    bool broken;
+    bool absent;        // no keyboard answered the last reset
+    SunPort* next;      // next port, forming a ring of all ports
+    void handleKey(uint8_t key);
+    void releaseAll();
+    bool isHeld(uint8_t key);
+    void setHeld(uint8_t key, bool pressed);
+    bool isHeldElsewhere(uint8_t key);
+    bool holdsAny();
+    uint8_t clearFromBuffer(int8_t count);
+    bool waitForResponse(uint8_t expected);
+    int waitAndRead();
+    void sendLEDs();
+
+public:
+    SunPort(Stream& link);
+    void join(SunPort& other);
+    void reset();
+    uint8_t getLayout();
+    void update();
+    void updateLEDs(uint8_t leds);
+    uint8_t getLEDs();
+    void toggleLEDs(uint8_t mask);
+    void flashLEDs(uint8_t mask);
+    void beep(unsigned long duration);
+
+    inline bool isBroken() {
+        return broken;
+    }
+
+    inline bool isAbsent() {
+        return absent;
+    }
+};
+
+#endif
@@ -31,6 +31,45 @@
 #define CODE_OR_MACRO(C, M) (C)
 #endif
 
+// layer key for layer n, see layers.h; a toggle key switches layer n on
+// when pressed, and off when pressed again
+#define LAYER_CODE(n)   (0xFE00 + (n))
+#define LAYER_TOGGLE(n) (0xFE80 + (n))
+
+#if USE_LAYERS == true
+#define LAYER_OR_NONE(n) LAYER_CODE(n)
+#else
+#define LAYER_OR_NONE(n) 0
+#endif
+
+// recorder keys, see recorder.h: start/stop recording slot n, play slot n
+#define REC_CODE(n)  (0xFC00 + (n))
+#define PLAY_CODE(n) (0xFC80 + (n))
+
+// mouse key, bits are directions and buttons, see mouse_keys.h
+#define MOUSE_KEY(bits) (0xFB00 + (bits))
+
+// leader key, see leader.h
+#define LEADER_CODE 0xFD00
+
+// consumer & system control usages, see usb_consumer.h
+#define CONSUMER_CODE(u) (0xFA00 + (u))
+#define SYSTEM_CODE(u)   (0xF900 + (u))
+
+#if USE_MEDIA_KEYS == true
+#define CODE_OR_CONSUMER(C, U) CONSUMER_CODE(U)
+#define CODE_OR_SYSTEM(C, U)   SYSTEM_CODE(U)
+#else
+#define CODE_OR_CONSUMER(C, U) (C)
+#define CODE_OR_SYSTEM(C, U)   (C)
+#endif
+
+#if USE_LEADER == true
+#define LEADER_OR_CODE(C) LEADER_CODE
+#else
+#define LEADER_OR_CODE(C) (C)
+#endif
+
 /*
     scan code lookup table:
 
@@ -43,6 +82,15 @@
         - modifiers are stored in high byte, with low byte 0
         - 0xFF in high byte indicates that a macro is to be used, low
           byte in this case is the ID of the macro
+        - 0xFE in high byte marks a layer key, low byte is the layer,
+          with bit 7 set for toggling
+        - 0xFD00 is the leader key
+        - 0xFC in high byte marks recorder keys, low byte is the slot,
+          with bit 7 set for playing
+        - 0xFB in high byte marks mouse keys, low byte has the directions
+          and buttons
+        - 0xFA in high byte marks a Consumer Control usage, and 0xF9 a
+          System Control usage, in the low byte
 
     The scan codes are according to the keyboard documentation. Note that
     while the documentation lists two scan sets - US and International -
@@ -52,17 +100,18 @@
     the same in each of the two scan sets.
 
     Translations were set to the same USB scan codes that a SUN Type 7
-    keyboard sends.
+    keyboard sends. The table is in flash, use it through Keymap (keymap.h),
+    which also applies the user's overrides.
  */
-static const uint16_t sun2usb[128] = {
+static constexpr uint16_t sun2usb[128] PROGMEM = {
 /*  scan                                        */
 /*  code    meaning          translation to USB */
 /*  --------------------------------------------*/
 /*  0x00                    */  0,
 /*  0x01    Stop            */  CODE_OR_MACRO(USB_STOP, MACRO_STOP),
-/*  0x02    Volume_Decr     */  USB_VOLUMEDOWN,
+/*  0x02    Volume_Decr     */  CODE_OR_CONSUMER(USB_VOLUMEDOWN, USB_CONSUMER_VOLUMEDOWN),
 /*  0x03    Again           */  CODE_OR_MACRO(USB_AGAIN, MACRO_AGAIN),
-/*  0x04    Volume_Incr     */  USB_VOLUMEUP,
+/*  0x04    Volume_Incr     */  CODE_OR_CONSUMER(USB_VOLUMEUP, USB_CONSUMER_VOLUMEUP),
 /*  0x05    F1              */  USB_F1,
 /*  0x06    F2              */  USB_F2,
 /*  0x07    F10             */  USB_F10,
@@ -103,10 +152,10 @@ static const uint16_t sun2usb[128] = {
 /*  0x2A    ‘_~             */  USB_GRAVE,
 /*  0x2B    Backspace       */  USB_BACKSPACE,
 /*  0x2C    T5_Insert       */  USB_INSERT,
-/*  0x2D    =               */  USB_MUTE,
+/*  0x2D    =               */  CODE_OR_CONSUMER(USB_MUTE, USB_CONSUMER_MUTE),
 /*  0x2E    /               */  USB_KPSLASH,
 /*  0x2F    *               */  USB_KPASTERISK,
-/*  0x30    Power           */  USB_POWER,
+/*  0x30    Power           */  CODE_OR_SYSTEM(USB_POWER, USB_SYSTEM_POWER),
 /*  0x31    Front           */  CODE_OR_MACRO(USB_FRONT, MACRO_FRONT),
 /*  0x32    Del_.           */  USB_KPDOT,
 /*  0x33    Copy            */  CODE_OR_MACRO(USB_COPY, MACRO_COPY),
@@ -169,14 +218,14 @@ static const uint16_t sun2usb[128] = {
 /*  0x6C    ._>             */  USB_DOT,
 /*  0x6D    /_?             */  USB_SLASH,
 /*  0x6E    Shift_R         */  USB_MOD_RSHIFT << 8,
-/*  0x6F    Line_Feed       */  0,
+/*  0x6F    Line_Feed       */  LAYER_OR_NONE(1),
 /*  0x70    End_1           */  USB_KP1,
 /*  0x71    Dn-Cur_2        */  USB_KP2,
 /*  0x72    PgDn_3          */  USB_KP3,
 /*  0x73                    */  0,
 /*  0x74                    */  0,
 /*  0x75                    */  0,
-/*  0x76    Help            */  CODE_OR_MACRO(USB_HELP, MACRO_HELP),
+/*  0x76    Help            */  LEADER_OR_CODE(CODE_OR_MACRO(USB_HELP, MACRO_HELP)),
 /*  0x77    CapsLock        */  USB_CAPSLOCK,
 /*  0x78    L-Triangle      */  USB_MOD_LMETA << 8,
 /*  0x79    SpaceBar        */  USB_SPACE,
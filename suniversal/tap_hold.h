@@ -0,0 +1,74 @@
+/*
+    tap_hold - dual role keys, doing one thing when tapped, another when held
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TAP_HOLD_h
+#define TAP_HOLD_h
+
+#include <Arduino.h>
+
+#include "sun_codes.h"
+#include "usb_codes.h"
+
+/*
+    When a dual role key goes down, we can't know yet what it's going to be,
+    so it's held back together with any keys that follow, until one of these
+    happens:
+
+     - the key is released within TAPPING_TERM: it's a tap
+     - TAPPING_TERM runs out while the key is still down: it's a hold
+     - with PERMISSIVE_HOLD, another key is pressed and released while the
+       key is down: it's a hold, e.g. Caps Lock + C for Ctrl-C typed quickly
+     - too many keys are waiting: it's a hold
+
+    Then the dual role key and whatever was held back are passed on in the
+    order they came in. Keys typed while no dual role key is down are not
+    held back at all.
+
+    Codes are as in sun_to_usb.h, so a hold can also switch on a layer with
+    LAYER_CODE(n). A tap code of 0 sends whatever the key is mapped to in
+    the keymap, so e.g. Compose still works as Compose when tapped.
+ */
+struct TapHoldKey {
+    uint8_t key;   // SUN scan code
+    uint16_t tap;  // code when tapped
+    uint16_t hold; // code when held
+};
+
+static const TapHoldKey tapHoldKeys[] PROGMEM = {
+    {CAPS_LOCK, USB_ESC, USB_MOD_LCTRL << 8},
+    {COMPOSE,   0,       USB_MOD_RMETA << 8}
+};
+
+// max number of keys held back while waiting for a decision
+#define TAP_HOLD_BUFFER 8
+
+/*
+    How long dual role keys and the keys behind them were held back until
+    a decision was made, in milliseconds.
+ */
+struct TapHoldLatency {
+    uint16_t last;
+    uint16_t max;
+    uint16_t decisions;
+};
+
+extern TapHoldLatency tapHoldLatency;
+
+#endif
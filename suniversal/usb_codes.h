@@ -283,4 +283,20 @@
 #define USB_MEDIA_REFRESH 0xfa
 #define USB_MEDIA_CALC 0xfb
 
+/*
+    Consumer Control usages (consumer page), and System Control usages
+    (generic desktop page), see usb_consumer.h
+ */
+#define USB_CONSUMER_NEXTSONG 0xb5 // Scan Next Track
+#define USB_CONSUMER_PREVIOUSSONG 0xb6 // Scan Previous Track
+#define USB_CONSUMER_STOP 0xb7 // Stop
+#define USB_CONSUMER_PLAYPAUSE 0xcd // Play/Pause
+#define USB_CONSUMER_MUTE 0xe2 // Mute
+#define USB_CONSUMER_VOLUMEUP 0xe9 // Volume Increment
+#define USB_CONSUMER_VOLUMEDOWN 0xea // Volume Decrement
+
+#define USB_SYSTEM_POWER 0x81 // System Power Down
+#define USB_SYSTEM_SLEEP 0x82 // System Sleep
+#define USB_SYSTEM_WAKEUP 0x83 // System Wake Up
+
 #endif // USB_HID_KEYS
@@ -0,0 +1,116 @@
+/*
+    USB consumer & system control
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+#include "usb_consumer.h"
+#include "hid_descriptor.h"
+
+#if defined(_USING_HID) && USE_MEDIA_KEYS == true
+
+static constexpr uint8_t hidReportDescriptorConsumer[] PROGMEM = {
+    // consumer control
+    RD_USAGE_PAGE(RD_PAGE_CONSUMER),
+    RD_USAGE(0x01),                         // Consumer Control
+    RD_COLLECTION(RD_APPLICATION),
+    RD_REPORT_ID(CONSUMER_REPORT_ID),
+    RD_LOGICAL_MINIMUM(0),
+    RD_LOGICAL_MAXIMUM16(255),
+    RD_USAGE_MINIMUM(0),
+    RD_USAGE_MAXIMUM16(255),
+    RD_REPORT_SIZE(8),
+    RD_REPORT_COUNT(1),
+    RD_INPUT(RD_DATA_ARY_ABS),
+    RD_END_COLLECTION,
+
+    // system control
+    RD_USAGE_PAGE(RD_PAGE_GENERIC_DESKTOP),
+    RD_USAGE(0x80),                         // System Control
+    RD_COLLECTION(RD_APPLICATION),
+    RD_REPORT_ID(SYSTEM_REPORT_ID),
+    RD_LOGICAL_MINIMUM(0),
+    RD_LOGICAL_MAXIMUM16(255),
+    RD_USAGE_MINIMUM(0),
+    RD_USAGE_MAXIMUM16(255),
+    RD_REPORT_SIZE(8),
+    RD_REPORT_COUNT(1),
+    RD_INPUT(RD_DATA_ARY_ABS),
+    RD_END_COLLECTION
+};
+
+// one usage byte per report
+static_assert(RD_REPORT_BITS(hidReportDescriptorConsumer, RD_MAIN_INPUT,
+    CONSUMER_REPORT_ID) == 8, "consumer report does not match descriptor");
+static_assert(RD_REPORT_BITS(hidReportDescriptorConsumer, RD_MAIN_INPUT,
+    SYSTEM_REPORT_ID) == 8, "system report does not match descriptor");
+static_assert(SYSTEM_REPORT_ID == CONSUMER_REPORT_ID + SYSTEM_CONTROL,
+    "report IDs need to follow each other");
+
+/*
+
+ */
+USBConsumer::USBConsumer() {
+    usages[CONSUMER_CONTROL] = 0;
+    usages[SYSTEM_CONTROL] = 0;
+    static HIDSubDescriptor node(hidReportDescriptorConsumer,
+        sizeof(hidReportDescriptorConsumer));
+    HID().AppendDescriptor(&node);
+}
+
+/*
+    Press or release usage in report (CONSUMER_CONTROL or SYSTEM_CONTROL).
+ */
+void USBConsumer::handleUsage(uint8_t report, uint8_t usage, bool pressed) {
+    if (pressed) {
+        usages[report] = usage;
+    } else if (usages[report] == usage) {
+        usages[report] = 0;
+    } else {
+        return;
+    }
+    send(report);
+}
+
+/*
+
+ */
+void USBConsumer::releaseAll() {
+    for (uint8_t r = CONSUMER_CONTROL; r <= SYSTEM_CONTROL; r++) {
+        if (usages[r] != 0) {
+            usages[r] = 0;
+            send(r);
+        }
+    }
+}
+
+/*
+
+ */
+void USBConsumer::send(uint8_t report) {
+#if USE_SUSPEND == true
+    if (USBDevice.isSuspended()) {
+        return;
+    }
+#endif
+    HID().SendReport(CONSUMER_REPORT_ID + report, &usages[report], 1);
+}
+
+USBConsumer usbConsumer;
+
+#endif
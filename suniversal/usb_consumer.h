@@ -0,0 +1,69 @@
+/*
+    USB consumer & system control
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USB_CONSUMER_h
+#define USB_CONSUMER_h
+
+#include <HID.h>
+
+// ---------------------------------------------------------------------------
+
+#if !defined(_USING_HID)
+#warning "Using legacy HID core (non pluggable)"
+#else
+
+// ---------------------------------------------------------------------------
+
+// report IDs on the HID interface shared with the mouse; system control
+// needs to follow consumer control, see USBConsumer::send
+#define CONSUMER_REPORT_ID 2
+#define SYSTEM_REPORT_ID   3
+
+// which of the two reports, as passed to handleUsage
+#define CONSUMER_CONTROL 0
+#define SYSTEM_CONTROL   1
+
+/*
+    Media keys, such as volume and mute, go out as Consumer Control, and
+    power keys as System Control reports. Both work with all common hosts,
+    unlike their counterparts on the keyboard page, and are sent on the HID
+    interface of the mouse, so they don't add any traffic to the keyboard
+    endpoint.
+
+    Each report carries one usage, i.e. one key at a time. A key pressed
+    while another one of the same report is held takes over, and releasing
+    the one no longer in the report does nothing.
+ */
+class USBConsumer {
+
+private:
+    uint8_t usages[2]; // held, by report
+    void send(uint8_t report);
+
+public:
+    USBConsumer();
+    void handleUsage(uint8_t report, uint8_t usage, bool pressed);
+    void releaseAll();
+};
+
+extern USBConsumer usbConsumer;
+
+#endif
+#endif
@@ -21,56 +21,83 @@
     along with suniversal. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
 #include "usb_keyboard.h"
+#include "hid_descriptor.h"
+#include "keymap.h"
 
-static const uint8_t hidReportDescriptorKeyboard[] PROGMEM = {
+static constexpr uint8_t hidReportDescriptorKeyboard[] PROGMEM = {
     //  Keyboard
-    0x05, 0x01,                      /* USAGE_PAGE (Generic Desktop) 47 */
-    0x09, 0x06,                      /* USAGE (Keyboard) */
-    0xa1, 0x01,                      /* COLLECTION (Application) */
-    0x05, 0x07,                      /*   USAGE_PAGE (Keyboard) */
+    RD_USAGE_PAGE(RD_PAGE_GENERIC_DESKTOP),
+    RD_USAGE(0x06),                         /* Keyboard */
+    RD_COLLECTION(RD_APPLICATION),
+    RD_USAGE_PAGE(RD_PAGE_KEYBOARD),
 
     /* Keyboard Modifiers (shift, alt, ...) */
-    0x19, 0xe0,                      /*   USAGE_MINIMUM (Keyboard LeftControl) */
-    0x29, 0xe7,                      /*   USAGE_MAXIMUM (Keyboard Right GUI) */
-    0x15, 0x00,                      /*   LOGICAL_MINIMUM (0) */
-    0x25, 0x01,                      /*   LOGICAL_MAXIMUM (1) */
-    0x75, 0x01,                      /*   REPORT_SIZE (1) */
-    0x95, 0x08,                      /*   REPORT_COUNT (8) */
-    0x81, 0x02,                      /*   INPUT (Data,Var,Abs) */
-
-    /* Reserved byte, used for consumer reports, only works with linux */
-    0x05, 0x0C,                      /*   Usage Page (Consumer) */
-    0x95, 0x01,                      /*   REPORT_COUNT (1) */
-    0x75, 0x08,                      /*   REPORT_SIZE (8) */
-    0x15, 0x00,                      /*   LOGICAL_MINIMUM (0) */
-    0x26, 0xFF, 0x00,                /*   LOGICAL_MAXIMUM (255) */
-    0x19, 0x00,                      /*   USAGE_MINIMUM (0) */
-    0x29, 0xFF,                      /*   USAGE_MAXIMUM (255) */
-    0x81, 0x00,                      /*   INPUT (Data,Ary,Abs) */
+    RD_USAGE_MINIMUM(0xe0),                 /* Keyboard LeftControl */
+    RD_USAGE_MAXIMUM(0xe7),                 /* Keyboard Right GUI */
+    RD_LOGICAL_MINIMUM(0),
+    RD_LOGICAL_MAXIMUM(1),
+    RD_REPORT_SIZE(1),
+    RD_REPORT_COUNT(8),
+    RD_INPUT(RD_DATA_VAR_ABS),
+
+    /* Reserved byte, media keys have their own reports (usb_consumer.h) */
+    RD_REPORT_COUNT(1),
+    RD_REPORT_SIZE(8),
+    RD_INPUT(RD_CNST_VAR_ABS),
 
     /* 5 LEDs for num lock etc, 3 left for advanced, custom usage */
-    0x05, 0x08,                      /*   USAGE_PAGE (LEDs) */
-    0x19, 0x01,                      /*   USAGE_MINIMUM (Num Lock) */
-    0x29, 0x08,                      /*   USAGE_MAXIMUM (Kana + 3 custom)*/
-    0x95, 0x08,                      /*   REPORT_COUNT (8) */
-    0x75, 0x01,                      /*   REPORT_SIZE (1) */
-    0x91, 0x02,                      /*   OUTPUT (Data,Var,Abs) */
+    RD_USAGE_PAGE(RD_PAGE_LEDS),
+    RD_USAGE_MINIMUM(0x01),                 /* Num Lock */
+    RD_USAGE_MAXIMUM(0x08),                 /* Kana + 3 custom */
+    RD_REPORT_COUNT(8),
+    RD_REPORT_SIZE(1),
+    RD_OUTPUT(RD_DATA_VAR_ABS),
 
     /* 6 Keyboard keys */
-    0x05, 0x07,                      /*   USAGE_PAGE (Keyboard) */
-    0x95, 0x06,                      /*   REPORT_COUNT (6) */
-    0x75, 0x08,                      /*   REPORT_SIZE (8) */
-    0x15, 0x00,                      /*   LOGICAL_MINIMUM (0) */
-    0x26, 0xE7, 0x00,                /*   LOGICAL_MAXIMUM (231) */
-    0x19, 0x00,                      /*   USAGE_MINIMUM (Reserved (no event indicated)) */
-    0x29, 0xE7,                      /*   USAGE_MAXIMUM (Keyboard Right GUI) */
-    0x81, 0x00,                      /*   INPUT (Data,Ary,Abs) */
+    RD_USAGE_PAGE(RD_PAGE_KEYBOARD),
+    RD_REPORT_COUNT(6),
+    RD_REPORT_SIZE(8),
+    RD_LOGICAL_MINIMUM(0),
+    RD_LOGICAL_MAXIMUM16(231),
+    RD_USAGE_MINIMUM(0x00),                 /* Reserved (no event indicated) */
+    RD_USAGE_MAXIMUM(0xe7),                 /* Keyboard Right GUI */
+    RD_INPUT(RD_DATA_ARY_ABS),
+
+#if USE_USER_KEYMAP == true
+    /* User keymap upload, see keymap.h */
+    RD_USAGE_PAGE16(RD_PAGE_VENDOR),
+    RD_USAGE(0x01),
+    RD_LOGICAL_MINIMUM(0),
+    RD_LOGICAL_MAXIMUM16(255),
+    RD_REPORT_SIZE(8),
+    RD_REPORT_COUNT(sizeof(KeymapReport)),
+    RD_FEATURE(RD_DATA_VAR_ABS),
+#endif
 
     /* End */
-    0xc0                            /* END_COLLECTION */
+    RD_END_COLLECTION
 };
 
+// report struct and LED byte need to match the descriptor
+static_assert(RD_REPORT_BITS(hidReportDescriptorKeyboard, RD_MAIN_INPUT, 0) ==
+    8 * sizeof(ReportData), "ReportData does not match descriptor");
+static_assert(RD_FIELD_OFFSET(hidReportDescriptorKeyboard, RD_MAIN_INPUT, 0, 0) ==
+    8 * offsetof(ReportData, modifiers), "modifiers offset mismatch");
+static_assert(RD_FIELD_OFFSET(hidReportDescriptorKeyboard, RD_MAIN_INPUT, 0, 1) ==
+    8 * offsetof(ReportData, reserved), "reserved offset mismatch");
+static_assert(RD_FIELD_OFFSET(hidReportDescriptorKeyboard, RD_MAIN_INPUT, 0, 2) ==
+    8 * offsetof(ReportData, keys), "keys offset mismatch");
+static_assert(RD_REPORT_BITS(hidReportDescriptorKeyboard, RD_MAIN_OUTPUT, 0) ==
+    8 * sizeof(uint8_t), "LED report does not match descriptor");
+#if USE_USER_KEYMAP == true
+static_assert(RD_REPORT_BITS(hidReportDescriptorKeyboard, RD_MAIN_FEATURE, 0) ==
+    8 * sizeof(KeymapReport), "KeymapReport does not match descriptor");
+static_assert(sizeof(KeymapReport) <= USB_EP_SIZE,
+    "keymap report needs to fit into one control transfer packet");
+#endif
+
 /*
 
  */
@@ -229,7 +256,7 @@ uint8_t USBKeyboard::getProtocol() {
 /*
 
  */
-USBKeyboard::setFeatureReport(void* report, int length){
+void USBKeyboard::setFeatureReport(void* report, int length){
     if(length > 0){
         featureReport = (uint8_t*)report;
         featureLength = length;
@@ -251,28 +278,43 @@ int USBKeyboard::availableFeatureReport() {
 /*
 
  */
-USBKeyboard::enableFeatureReport() {
+void USBKeyboard::enableFeatureReport() {
     featureLength &= ~0x8000;
 }
 
 /*
 
  */
-USBKeyboard::disableFeatureReport() {
+void USBKeyboard::disableFeatureReport() {
     featureLength |= 0x8000;
 }
 
 /*
 
  */
-USBKeyboard::setReportData(ReportData* data) {
+void USBKeyboard::setReportData(ReportData* data) {
     reportData = data;
 }
 
+/*
+    Returns true if a report can be sent without waiting, i.e. the host has
+    picked up what we sent before. Used for pacing macros, so they go out
+    as fast as the host accepts them, but never block.
+ */
+bool USBKeyboard::ready() {
+    return USB_SendSpace(pluggedEndpoint) >= sizeof(ReportData);
+}
+
 /*
 
  */
 int USBKeyboard::send() {
+#if USE_SUSPEND == true
+    // host would not pick it up, and we'd wait for it
+    if (USBDevice.isSuspended()) {
+        return 0;
+    }
+#endif
     return reportData != NULL ?
         USB_Send(pluggedEndpoint | TRANSFER_RELEASE,
             reportData, sizeof(ReportData)) : 0;
@@ -281,7 +323,7 @@ int USBKeyboard::send() {
 /*
 
  */
-USBKeyboard::wakeupHost() {
+void USBKeyboard::wakeupHost() {
     USBDevice.wakeupHost();
 }
 
@@ -83,13 +83,14 @@ public:
     USBKeyboard();
     uint8_t getLeds();
     uint8_t getProtocol();
-    setFeatureReport(void* report, int length);
+    void setFeatureReport(void* report, int length);
     int availableFeatureReport();
-    enableFeatureReport();
-    disableFeatureReport();
-    setReportData(ReportData* data);
+    void enableFeatureReport();
+    void disableFeatureReport();
+    void setReportData(ReportData* data);
+    bool ready();
     int send();
-    wakeupHost();
+    void wakeupHost();
 };
 
 extern USBKeyboard usbKeyboard;
@@ -20,49 +20,62 @@
     along with suniversal. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
 #include "usb_mouse.h"
+#include "hid_descriptor.h"
 
 #if defined(_USING_HID)
 
-static const uint8_t hidReportDescriptorMouse[] PROGMEM = {
+static constexpr uint8_t hidReportDescriptorMouse[] PROGMEM = {
     // mouse
-    0x05, 0x01,         // USAGE_PAGE (Generic Desktop)  // 54
-    0x09, 0x02,         // USAGE (Mouse)
-    0xa1, 0x01,         // COLLECTION (Application)
-    0x09, 0x01,         //   USAGE (Pointer)
-    0xa1, 0x00,         //   COLLECTION (Physical)
-    0x85, 0x01,         //     REPORT_ID (1)
-    0x05, 0x09,         //     USAGE_PAGE (Button)
-    0x19, 0x01,         //     USAGE_MINIMUM (Button 1)
-    0x29, 0x03,         //     USAGE_MAXIMUM (Button 3)
-    0x15, 0x00,         //     LOGICAL_MINIMUM (0)
-    0x25, 0x01,         //     LOGICAL_MAXIMUM (1)
-    0x95, 0x03,         //     REPORT_COUNT (3)
-    0x75, 0x01,         //     REPORT_SIZE (1)
-    0x81, 0x02,         //     INPUT (Data,Var,Abs)
-    0x95, 0x01,         //     REPORT_COUNT (1)
-    0x75, 0x05,         //     REPORT_SIZE (5)
-    0x81, 0x03,         //     INPUT (Cnst,Var,Abs)
-    0x05, 0x01,         //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30,         //     USAGE (X)
-    0x09, 0x31,         //     USAGE (Y)
-    0x09, 0x38,         //     USAGE (Wheel)
-    0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,         //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,         //     REPORT_SIZE (8)
-    0x95, 0x03,         //     REPORT_COUNT (3)
-    0x81, 0x06,         //     INPUT (Data,Var,Rel)
-    0x05, 0x0c,         //     USAGE PAGE (Consumer Devices)
-    0x0a, 0x38, 0x02,   //     USAGE (AC Pan)
-    0x15, 0x81,         //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,         //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,         //     REPORT_SIZE (8)
-    0x95, 0x01,         //     REPORT_COUNT (1)
-    0x81, 0x06,         //     INPUT (Data, Var, Rel)
-    0xc0,               //   END_COLLECTION
-    0xc0,               // END_COLLECTION
+    RD_USAGE_PAGE(RD_PAGE_GENERIC_DESKTOP),
+    RD_USAGE(0x02),                         // Mouse
+    RD_COLLECTION(RD_APPLICATION),
+    RD_USAGE(0x01),                         //   Pointer
+    RD_COLLECTION(RD_PHYSICAL),
+    RD_REPORT_ID(MOUSE_REPORT_ID),
+    RD_USAGE_PAGE(RD_PAGE_BUTTON),
+    RD_USAGE_MINIMUM(1),                    //     Button 1
+    RD_USAGE_MAXIMUM(3),                    //     Button 3
+    RD_LOGICAL_MINIMUM(0),
+    RD_LOGICAL_MAXIMUM(1),
+    RD_REPORT_COUNT(3),
+    RD_REPORT_SIZE(1),
+    RD_INPUT(RD_DATA_VAR_ABS),
+    RD_REPORT_COUNT(1),
+    RD_REPORT_SIZE(5),
+    RD_INPUT(RD_CNST_VAR_ABS),
+    RD_USAGE_PAGE(RD_PAGE_GENERIC_DESKTOP),
+    RD_USAGE(0x30),                         //     X
+    RD_USAGE(0x31),                         //     Y
+    RD_USAGE(0x38),                         //     Wheel
+    RD_LOGICAL_MINIMUM(-127),
+    RD_LOGICAL_MAXIMUM(127),
+    RD_REPORT_SIZE(8),
+    RD_REPORT_COUNT(3),
+    RD_INPUT(RD_DATA_VAR_REL),
+    RD_USAGE_PAGE(RD_PAGE_CONSUMER),
+    RD_USAGE16(0x0238),                     //     AC Pan
+    RD_LOGICAL_MINIMUM(-127),
+    RD_LOGICAL_MAXIMUM(127),
+    RD_REPORT_SIZE(8),
+    RD_REPORT_COUNT(1),
+    RD_INPUT(RD_DATA_VAR_REL),
+    RD_END_COLLECTION,
+    RD_END_COLLECTION,
 };
 
+// report struct needs to match the descriptor
+static_assert(RD_REPORT_BITS(hidReportDescriptorMouse, RD_MAIN_INPUT,
+    MOUSE_REPORT_ID) == 8 * sizeof(MouseReportData),
+    "MouseReportData does not match descriptor");
+static_assert(RD_FIELD_OFFSET(hidReportDescriptorMouse, RD_MAIN_INPUT,
+    MOUSE_REPORT_ID, 2) == 8 * offsetof(MouseReportData, x),
+    "x offset mismatch");
+static_assert(RD_FIELD_OFFSET(hidReportDescriptorMouse, RD_MAIN_INPUT,
+    MOUSE_REPORT_ID, 3) == 8 * offsetof(MouseReportData, pan),
+    "pan offset mismatch");
+
 /*
 
  */
@@ -75,21 +88,21 @@ USBMouse::USBMouse() : buttons(0) {
 /*
 
  */
-USBMouse::move(signed char x, signed char y) {
+void USBMouse::move(signed char x, signed char y) {
     send(x, y, 0, 0);
 }
 
 /*
 
  */
-USBMouse::scroll(signed char v, signed char h) {
+void USBMouse::scroll(signed char v, signed char h) {
     send(0, 0, v, h);
 }
 
 /*
 
  */
-USBMouse::setButtons(uint8_t b) {
+void USBMouse::setButtons(uint8_t b) {
     if (b != buttons) {
         buttons = b;
         send(0, 0, 0, 0);
@@ -99,21 +112,21 @@ USBMouse::setButtons(uint8_t b) {
 /*
 
  */
-USBMouse::press(uint8_t b) {
+void USBMouse::press(uint8_t b) {
     setButtons(buttons | b);
 }
 
 /*
 
  */
-USBMouse::release(uint8_t b) {
+void USBMouse::release(uint8_t b) {
     setButtons(buttons & ~b);
 }
 
 /*
 
  */
-USBMouse::click(uint8_t b) {
+void USBMouse::click(uint8_t b) {
     buttons = b;
     send(0, 0, 0, 0);
     buttons = 0;
@@ -123,13 +136,18 @@ USBMouse::click(uint8_t b) {
 /*
 
  */
-USBMouse::send(uint8_t x, uint8_t y, uint8_t v, uint8_t h) {
-    reportData[0] = buttons;
-    reportData[1] = x;
-    reportData[2] = y;
-    reportData[3] = v;
-    reportData[4] = h;
-    HID().SendReport(1, reportData, sizeof(reportData));
+void USBMouse::send(uint8_t x, uint8_t y, uint8_t v, uint8_t h) {
+#if USE_SUSPEND == true
+    if (USBDevice.isSuspended()) {
+        return;
+    }
+#endif
+    reportData.buttons = buttons;
+    reportData.x = x;
+    reportData.y = y;
+    reportData.wheel = v;
+    reportData.pan = h;
+    HID().SendReport(MOUSE_REPORT_ID, &reportData, sizeof(reportData));
 }
 
 USBMouse usbMouse;
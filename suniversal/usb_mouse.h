@@ -38,24 +38,37 @@
 #define MOUSE_MIDDLE  4
 #define MOUSE_ALL (MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE)
 
+#define MOUSE_REPORT_ID 1
+
+/*
+    mouse report data, without report ID
+ */
+struct MouseReportData {
+    uint8_t buttons;
+    uint8_t x;
+    uint8_t y;
+    uint8_t wheel;
+    uint8_t pan;
+};
+
 /*
 
  */
 class USBMouse {
 
 private:
-    uint8_t reportData[5];
+    MouseReportData reportData;
     uint8_t buttons;
-    setButtons(uint8_t b);
-    send(uint8_t x, uint8_t y, uint8_t v, uint8_t h);
+    void setButtons(uint8_t b);
+    void send(uint8_t x, uint8_t y, uint8_t v, uint8_t h);
 
 public:
     USBMouse();
-    move(signed char x, signed char y);
-    scroll(signed char v, signed char h);
-    click(uint8_t b);
-    release(uint8_t b);
-    press(uint8_t b);
+    void move(signed char x, signed char y);
+    void scroll(signed char v, signed char h);
+    void click(uint8_t b);
+    void release(uint8_t b);
+    void press(uint8_t b);
 };
 
 extern USBMouse usbMouse;
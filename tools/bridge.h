@@ -0,0 +1,43 @@
+/*
+    bridge - sketch settings for sunbridge
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRIDGE_h
+#define BRIDGE_h
+
+/*
+    Included ahead of the sketch sources sunbridge is built from, overriding
+    config.h. The mouse pipeline stages keep their state in globals, but
+    sunbridge runs any number of mice through the one pipeline. So stages
+    that remember anything between frames are left out:
+
+     - scroll emulation would see the middle button of whichever mouse
+       changed it last; libinput has on-button scrolling for that, which
+       can be set per device
+     - interpolation would mix up the motion of all mice, and sunbridge
+       doesn't need it, since there's no USB polling in between
+ */
+#include "config.h"
+
+#undef EMULATE_SCROLL_WHEEL
+#define EMULATE_SCROLL_WHEEL false
+#undef INTERPOLATE_MOUSE
+#define INTERPOLATE_MOUSE false
+
+#endif
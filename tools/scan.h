@@ -0,0 +1,97 @@
+/*
+    scan - fast search for marker bytes in captures, for the host tools
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCAN_h
+#define SCAN_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+    Looking for bytes b with (b & mask) == value, e.g. mouse frame starts
+    with FRAME_START_MASK and DATA_FRAME_START, or keyboard responses with
+    mask 0xFF. With SSE2, 16 bytes are checked at once, otherwise one by one.
+ */
+
+#ifdef __SSE2__
+
+// bit n set if byte n of the 16 at p matches
+static inline uint32_t matchBlock(const uint8_t* p, __m128i mask,
+    __m128i value) {
+    __m128i b = _mm_loadu_si128((const __m128i*)p);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(b, mask), value));
+}
+
+#endif
+
+/*
+    Returns the first matching byte in [p, end), or end if there is none.
+ */
+static inline const uint8_t* findByte(const uint8_t* p, const uint8_t* end,
+    uint8_t mask, uint8_t value) {
+
+#ifdef __SSE2__
+    __m128i m = _mm_set1_epi8(mask);
+    __m128i v = _mm_set1_epi8(value);
+    for (; end - p >= 16; p += 16) {
+        uint32_t bits = matchBlock(p, m, v);
+        if (bits != 0) {
+            return p + __builtin_ctz(bits);
+        }
+    }
+#endif
+
+    for (; p < end; p++) {
+        if ((*p & mask) == value) {
+            return p;
+        }
+    }
+    return end;
+}
+
+/*
+    Returns the number of matching bytes in [p, end).
+ */
+static inline uint64_t countBytes(const uint8_t* p, const uint8_t* end,
+    uint8_t mask, uint8_t value) {
+
+    uint64_t count = 0;
+
+#ifdef __SSE2__
+    __m128i m = _mm_set1_epi8(mask);
+    __m128i v = _mm_set1_epi8(value);
+    for (; end - p >= 16; p += 16) {
+        count += __builtin_popcount(matchBlock(p, m, v));
+    }
+#endif
+
+    for (; p < end; p++) {
+        if ((*p & mask) == value) {
+            count++;
+        }
+    }
+    return count;
+}
+
+#endif
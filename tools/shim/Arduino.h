@@ -0,0 +1,92 @@
+/*
+    Arduino.h for building sketch sources on a Linux host
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_ARDUINO_h
+#define HOST_ARDUINO_h
+
+/*
+    Just enough of the Arduino API for the sketch sources the host tools
+    reuse, i.e. the parts that don't touch hardware. Flash is ordinary
+    memory here, and time comes from host.cpp.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <type_traits>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_ptr(p)  (*(void* const*)(p))
+#define memcpy_P memcpy
+#define strchr_P strchr
+#define strlen_P strlen
+
+typedef uint8_t byte;
+
+// templates rather than the usual macros, so they don't break std::min/max;
+// they return by value, the conditional alone would give a reference
+template <class A, class B>
+inline auto min(A a, B b) ->
+    typename std::remove_reference<decltype(a < b ? a : b)>::type {
+    return a < b ? a : b;
+}
+template <class A, class B>
+inline auto max(A a, B b) ->
+    typename std::remove_reference<decltype(a > b ? a : b)>::type {
+    return a > b ? a : b;
+}
+#define constrain(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+/*
+    Serial links, for the sketch's SunPort. Tools derive their own streams,
+    e.g. for reading captures.
+ */
+class Stream {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buf, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            write(buf[i]);
+        }
+        return n;
+    }
+};
+
+/*
+    By default, millis() and micros() follow the host's monotonic clock.
+    Tools that replay recorded or simulated data can switch to virtual time,
+    which only moves when they set it.
+ */
+void hostUseVirtualTime(bool on);
+void hostSetTime(uint64_t us);
+uint64_t hostTime();
+
+#endif
@@ -0,0 +1,54 @@
+/*
+    EEPROM.h for building sketch sources on a Linux host, see Arduino.h
+ */
+
+#ifndef HOST_EEPROM_h
+#define HOST_EEPROM_h
+
+#include <stdint.h>
+#include <string.h>
+
+#define E2END 0x3FF
+
+/*
+    EEPROM is plain memory, starting out erased, i.e. all 0xFF. Nothing is
+    kept between runs.
+ */
+class EEPROMClass {
+public:
+    uint8_t data[E2END + 1];
+
+    EEPROMClass() {
+        memset(data, 0xFF, sizeof(data));
+    }
+
+    uint8_t read(int a) {
+        return data[a];
+    }
+
+    void write(int a, uint8_t v) {
+        data[a] = v;
+    }
+
+    void update(int a, uint8_t v) {
+        data[a] = v;
+    }
+
+    uint16_t length() {
+        return sizeof(data);
+    }
+
+    template <class T> T& get(int a, T& t) {
+        memcpy(&t, &data[a], sizeof(T));
+        return t;
+    }
+
+    template <class T> const T& put(int a, const T& t) {
+        memcpy(&data[a], &t, sizeof(T));
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
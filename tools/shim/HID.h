@@ -0,0 +1,11 @@
+/*
+    HID.h for building sketch sources on a Linux host, see Arduino.h
+ */
+
+#ifndef HOST_HID_h
+#define HOST_HID_h
+
+// the USB classes are implemented by the tools themselves
+#define _USING_HID
+
+#endif
@@ -0,0 +1,34 @@
+/*
+    PluggableUSB.h for building sketch sources on a Linux host, see Arduino.h
+ */
+
+#ifndef HOST_PLUGGABLE_USB_h
+#define HOST_PLUGGABLE_USB_h
+
+#include <stdint.h>
+
+// what usb_keyboard.h checks for
+#ifndef ARDUINO
+#define ARDUINO 10607
+#endif
+#define USBCON
+
+struct USBSetup {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint8_t wValueL;
+    uint8_t wValueH;
+    uint16_t wIndex;
+    uint16_t wLength;
+};
+
+class PluggableUSBModule {
+public:
+    PluggableUSBModule(uint8_t numEps, uint8_t numIfs, uint8_t* epType) {}
+protected:
+    virtual bool setup(USBSetup& setup) = 0;
+    virtual int getInterface(uint8_t* interfaceCount) = 0;
+    virtual int getDescriptor(USBSetup& setup) = 0;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+    host side of the Arduino shim
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+static bool virtualTime = false;
+static uint64_t now = 0;
+
+void hostUseVirtualTime(bool on) {
+    virtualTime = on;
+}
+
+void hostSetTime(uint64_t us) {
+    now = us;
+}
+
+uint64_t hostTime() {
+    if (virtualTime) {
+        return now;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long millis() {
+    return hostTime() / 1000;
+}
+
+unsigned long micros() {
+    return hostTime();
+}
+
+/*
+    In virtual time, delay just moves the clock.
+ */
+void delay(unsigned long ms) {
+    if (virtualTime) {
+        now += (uint64_t)ms * 1000;
+    } else {
+        usleep(ms * 1000);
+    }
+}
@@ -0,0 +1,19 @@
+/*
+    util/crc16.h for building sketch sources on a Linux host, see Arduino.h
+ */
+
+#ifndef HOST_CRC16_h
+#define HOST_CRC16_h
+
+#include <stdint.h>
+
+// same as avr-libc's, minus the assembly
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,581 @@
+/*
+    sunbridge - SUN keyboards & mice on serial ports to Linux input devices
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Instead of an Arduino, the keyboard (or mouse) is connected to a USB
+    serial adapter, with the signal inverted externally just like for the
+    Arduino. For each port, sunbridge creates an input device via uinput.
+    Keys are translated with the sketch's sun2usb table, and mouse data is
+    decoded by the sketch's MouseConverter. LED and bell changes from the
+    host are sent back to the keyboard.
+
+    All ports are handled by a single thread, waiting on epoll. Ports that
+    go away, e.g. when the adapter is unplugged, are reopened once a second.
+
+    usage: sunbridge [-n] [-s secs] [-k tty]... [-m tty]...
+
+        -k tty   keyboard on tty
+        -m tty   mouse on tty
+        -n       dry run, print input events instead of creating devices
+        -s secs  print latency statistics every secs seconds
+
+    Statistics are also printed on SIGUSR1 and at exit. Latency is the time
+    from reading bytes off a port to having written the resulting input
+    events. Pseudo terminals can stand in for serial ports when testing.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/uinput.h>
+
+#include <vector>
+
+#include <Arduino.h>
+
+#include "mouse.h"
+#include "translate.h"
+#include "evdev.h"
+
+#define SOURCE_TTY    0
+#define SOURCE_UINPUT 1
+#define ID_SIGNAL     0xFFFFFFF0
+#define ID_TIMER      0xFFFFFFF1
+
+// latency histogram, bucket n counts events below 2^n us
+#define BUCKETS 24
+
+struct Stats {
+    uint64_t events;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+};
+
+struct Port {
+    const char* path;
+    bool mouse;
+    int fd;           // tty, -1 while closed
+    int out;          // uinput device, -1 in dry run
+    uint8_t skip;     // bytes of a keyboard response still to skip
+    uint8_t held[16]; // keys held on keyboard
+    uint8_t buttons;  // mouse buttons held
+    uint8_t leds;     // keyboard LEDs, as SUN LED mask
+    MouseConverter* converter;
+    uint64_t readAt;  // when the bytes being handled were read
+    bool pending;     // events written since last SYN
+    Stats stats;
+};
+
+static std::vector<Port> ports;
+static bool dryRun = false;
+static int epoll = -1;
+static Port* current = NULL; // port the mouse converter is working for
+
+// --- output ------------------------------------------------------------------
+
+static void emit(Port& p, uint16_t type, uint16_t code, int32_t value) {
+
+    if (dryRun) {
+        printf("%s %u %u %d\n", p.path, type, code, value);
+    } else {
+        struct input_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        if (write(p.out, &ev, sizeof(ev)) != sizeof(ev)) {
+            perror("sunbridge: writing event");
+        }
+    }
+
+    if (type != EV_SYN) {
+        p.pending = true;
+        return;
+    }
+
+    p.pending = false;
+    uint64_t latency = hostTime() - p.readAt;
+    Stats& s = p.stats;
+    s.events++;
+    s.sum += latency;
+    if (latency > s.max) {
+        s.max = latency;
+    }
+    uint8_t b = 0;
+    while (b < BUCKETS - 1 && latency >= (1ULL << b)) {
+        b++;
+    }
+    s.buckets[b]++;
+}
+
+static void sync(Port& p) {
+    if (p.pending) {
+        emit(p, EV_SYN, SYN_REPORT, 0);
+    }
+}
+
+static int createDevice(Port& p, int index) {
+
+    int fd = open("/dev/uinput", O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        perror("sunbridge: /dev/uinput");
+        return -1;
+    }
+
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+
+    if (p.mouse) {
+        ioctl(fd, UI_SET_EVBIT, EV_REL);
+        ioctl(fd, UI_SET_RELBIT, REL_X);
+        ioctl(fd, UI_SET_RELBIT, REL_Y);
+        ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+        ioctl(fd, UI_SET_RELBIT, REL_HWHEEL);
+        ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+        ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT);
+        ioctl(fd, UI_SET_KEYBIT, BTN_MIDDLE);
+    } else {
+        ioctl(fd, UI_SET_EVBIT, EV_REP);
+        ioctl(fd, UI_SET_EVBIT, EV_LED);
+        ioctl(fd, UI_SET_EVBIT, EV_SND);
+        ioctl(fd, UI_SET_LEDBIT, LED_NUML);
+        ioctl(fd, UI_SET_LEDBIT, LED_CAPSL);
+        ioctl(fd, UI_SET_LEDBIT, LED_SCROLLL);
+        ioctl(fd, UI_SET_LEDBIT, LED_COMPOSE);
+        ioctl(fd, UI_SET_SNDBIT, SND_BELL);
+        for (int i = 0; i < 256; i++) {
+            if (hidToEvdev[i] != 0) {
+                ioctl(fd, UI_SET_KEYBIT, hidToEvdev[i]);
+            }
+        }
+    }
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_RS232;
+    setup.id.vendor = 0x0430; // Sun Microsystems
+    snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "SUN %s %d",
+        p.mouse ? "mouse" : "keyboard", index);
+
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        perror("sunbridge: creating input device");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- mouse -------------------------------------------------------------------
+
+/*
+    The mouse converter's pipeline ends in usbMouse, which here turns into
+    input events for the port that's currently being handled. The pipeline
+    stages are shared by all mouse ports, so the ones keeping state between
+    frames are left out, see bridge.h.
+ */
+USBMouse::USBMouse() : buttons(0) {}
+
+void USBMouse::move(signed char x, signed char y) {
+    emit(*current, EV_REL, REL_X, x);
+    emit(*current, EV_REL, REL_Y, y);
+    sync(*current);
+}
+
+void USBMouse::scroll(signed char v, signed char h) {
+    if (v != 0) {
+        emit(*current, EV_REL, REL_WHEEL, v);
+    }
+    if (h != 0) {
+        emit(*current, EV_REL, REL_HWHEEL, h);
+    }
+    sync(*current);
+}
+
+static void setMouseButtons(uint8_t b) {
+    static const uint16_t codes[] = {BTN_LEFT, BTN_RIGHT, BTN_MIDDLE};
+    uint8_t changed = b ^ current->buttons;
+    for (uint8_t i = 0; i < 3; i++) {
+        if (changed & (1 << i)) {
+            emit(*current, EV_KEY, codes[i], (b >> i) & 1);
+        }
+    }
+    current->buttons = b;
+    sync(*current);
+}
+
+void USBMouse::press(uint8_t b) {
+    setMouseButtons(current->buttons | b);
+}
+
+void USBMouse::release(uint8_t b) {
+    setMouseButtons(current->buttons & ~b);
+}
+
+USBMouse usbMouse;
+
+// --- keyboard ----------------------------------------------------------------
+
+static void emitKey(Port& p, uint8_t key, bool pressed) {
+
+    uint16_t code = sunToUsb(key);
+    uint8_t mods = code >> 8;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (mods & (1 << i)) {
+            emit(p, EV_KEY, hidToEvdev[0xE0 + i], pressed);
+        }
+    }
+    if (hidToEvdev[code & 0xFF] != 0) {
+        emit(p, EV_KEY, hidToEvdev[code & 0xFF], pressed);
+    }
+
+    if (pressed) {
+        p.held[key >> 3] |= 1 << (key & 0x07);
+    } else {
+        p.held[key >> 3] &= ~(1 << (key & 0x07));
+    }
+}
+
+static void releaseAll(Port& p) {
+    for (uint8_t key = 0; key < 128; key++) {
+        if (p.held[key >> 3] & (1 << (key & 0x07))) {
+            emitKey(p, key, false);
+        }
+    }
+    sync(p);
+}
+
+static void handleKeyboard(Port& p, uint8_t b) {
+
+    if (p.skip > 0) {
+        p.skip--;
+        return;
+    }
+
+    switch (b) {
+        case KBD_RESET_RESP: // followed by 0x04 and 0x7F or held key
+            p.skip = 2;
+            return;
+        case KBD_LAYOUT_RESP: // followed by layout
+            p.skip = 1;
+            return;
+        case 0x7E: // self test failed, followed by 0x01
+            fprintf(stderr, "sunbridge: %s: keyboard self test failed\n",
+                p.path);
+            p.skip = 1;
+            return;
+        case KBD_IDLE:
+            releaseAll(p);
+            return;
+    }
+
+    emitKey(p, b & ~BREAK_BIT, (b & BREAK_BIT) == 0);
+    sync(p);
+}
+
+/*
+    LED or bell change from the host.
+ */
+static void handleHost(Port& p) {
+
+    struct input_event ev;
+    uint8_t cmd[2] = {CMD_LED, 0};
+
+    while (read(p.out, &ev, sizeof(ev)) == sizeof(ev)) {
+        if (p.fd < 0) {
+            continue;
+        }
+        if (ev.type == EV_LED) {
+            uint8_t mask = 0;
+            switch (ev.code) {
+                case LED_NUML:    mask = NUM_LOCK_MASK;    break;
+                case LED_CAPSL:   mask = CAPS_LOCK_MASK;   break;
+                case LED_SCROLLL: mask = SCROLL_LOCK_MASK; break;
+                case LED_COMPOSE: mask = COMPOSE_MASK;     break;
+            }
+            p.leds = ev.value ? (p.leds | mask) : (p.leds & ~mask);
+            cmd[1] = p.leds;
+            if (write(p.fd, cmd, 2) != 2) {
+                perror("sunbridge: writing LEDs");
+            }
+        } else if (ev.type == EV_SND && ev.code == SND_BELL) {
+            uint8_t c = ev.value ? CMD_BELL_ON : CMD_BELL_OFF;
+            if (write(p.fd, &c, 1) != 1) {
+                perror("sunbridge: writing bell");
+            }
+        }
+    }
+}
+
+// --- ports -------------------------------------------------------------------
+
+static bool openPort(Port& p, uint32_t index) {
+
+    int fd = open(p.path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B1200);
+        cfsetospeed(&tio, B1200);
+        tio.c_cflag |= CLOCAL | CREAD;
+        if (p.mouse) {
+            tio.c_cflag |= CSTOPB;
+        }
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = index << 1 | SOURCE_TTY;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev);
+
+    p.fd = fd;
+    p.skip = 0;
+    if (!p.mouse) {
+        // reset, and restore LEDs the host had set, e.g. after re-plugging
+        uint8_t cmd[3] = {CMD_RESET, CMD_LED, p.leds};
+        if (write(fd, cmd, 3) != 3) {
+            perror("sunbridge: resetting keyboard");
+        }
+    }
+
+    fprintf(stderr, "sunbridge: %s: opened\n", p.path);
+    return true;
+}
+
+static void closePort(Port& p) {
+    fprintf(stderr, "sunbridge: %s: closed\n", p.path);
+    epoll_ctl(epoll, EPOLL_CTL_DEL, p.fd, NULL);
+    close(p.fd);
+    p.fd = -1;
+    p.readAt = hostTime();
+    if (p.mouse) {
+        current = &p;
+        setMouseButtons(0);
+    } else {
+        releaseAll(p);
+    }
+}
+
+static void readPort(Port& p) {
+
+    uint8_t buf[256];
+    ssize_t n = read(p.fd, buf, sizeof(buf));
+
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            closePort(p);
+        }
+        return;
+    }
+
+    p.readAt = hostTime();
+    current = &p;
+    for (ssize_t i = 0; i < n; i++) {
+        if (p.mouse) {
+            p.converter->update(buf[i], n > 1);
+        } else {
+            handleKeyboard(p, buf[i]);
+        }
+    }
+}
+
+// --- statistics --------------------------------------------------------------
+
+static void printStats() {
+    for (size_t i = 0; i < ports.size(); i++) {
+        Stats& s = ports[i].stats;
+        uint64_t p99 = 0;
+        uint64_t count = 0;
+        for (uint8_t b = 0; b < BUCKETS; b++) {
+            count += s.buckets[b];
+            if (count * 100 >= s.events * 99) {
+                p99 = 1ULL << b;
+                break;
+            }
+        }
+        fprintf(stderr, "sunbridge: %s: %llu events, latency avg %lluus, "
+            "p99 < %lluus, max %lluus\n", ports[i].path,
+            (unsigned long long)s.events,
+            (unsigned long long)(s.events > 0 ? s.sum / s.events : 0),
+            (unsigned long long)p99, (unsigned long long)s.max);
+    }
+}
+
+// --- main --------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+
+    int statsInterval = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:m:ns:")) != -1) {
+        switch (opt) {
+            case 'k':
+            case 'm': {
+                Port p;
+                memset(&p, 0, sizeof(p));
+                p.path = optarg;
+                p.mouse = opt == 'm';
+                p.fd = -1;
+                p.out = -1;
+                ports.push_back(p);
+                break;
+            }
+            case 'n':
+                dryRun = true;
+                break;
+            case 's':
+                statsInterval = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n] [-s secs] [-k tty]... "
+                    "[-m tty]...\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (ports.empty()) {
+        fprintf(stderr, "sunbridge: no ports given\n");
+        return 1;
+    }
+
+    epoll = epoll_create1(0);
+
+    for (size_t i = 0; i < ports.size(); i++) {
+        Port& p = ports[i];
+        if (p.mouse) {
+            p.converter = new MouseConverter();
+        }
+        if (!dryRun) {
+            p.out = createDevice(p, i);
+            if (p.out < 0) {
+                return 1;
+            }
+            if (!p.mouse) {
+                struct epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.u32 = i << 1 | SOURCE_UINPUT;
+                epoll_ctl(epoll, EPOLL_CTL_ADD, p.out, &ev);
+            }
+        }
+        if (!openPort(p, i)) {
+            fprintf(stderr, "sunbridge: %s: %s, retrying\n", p.path,
+                strerror(errno));
+        }
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    int sfd = signalfd(-1, &signals, 0);
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    struct itimerspec second = {{1, 0}, {1, 0}};
+    timerfd_settime(tfd, 0, &second, NULL);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = ID_SIGNAL;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, sfd, &ev);
+    ev.data.u32 = ID_TIMER;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, tfd, &ev);
+
+    bool running = true;
+    uint64_t seconds = 0;
+    struct epoll_event events[64];
+
+    while (running) {
+
+        int n = epoll_wait(epoll, events, 64, -1);
+        if (n < 0 && errno != EINTR) {
+            perror("sunbridge: epoll");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+
+            uint32_t id = events[i].data.u32;
+
+            if (id == ID_SIGNAL) {
+                struct signalfd_siginfo si;
+                if (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1) {
+                        printStats();
+                    } else {
+                        running = false;
+                    }
+                }
+
+            } else if (id == ID_TIMER) {
+                uint64_t ticks;
+                if (read(tfd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+                    seconds += ticks;
+                }
+                for (size_t j = 0; j < ports.size(); j++) {
+                    if (ports[j].fd < 0) {
+                        openPort(ports[j], j);
+                    }
+                }
+                if (statsInterval > 0 && seconds % statsInterval == 0) {
+                    printStats();
+                }
+
+            } else {
+                Port& p = ports[id >> 1];
+                if ((id & 1) == SOURCE_UINPUT) {
+                    handleHost(p);
+                } else if (p.fd >= 0) {
+                    if (events[i].events & EPOLLIN) {
+                        readPort(p);
+                    } else {
+                        closePort(p);
+                    }
+                }
+            }
+        }
+        fflush(stdout);
+    }
+
+    printStats();
+    for (size_t i = 0; i < ports.size(); i++) {
+        if (ports[i].out >= 0) {
+            ioctl(ports[i].out, UI_DEV_DESTROY);
+            close(ports[i].out);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,648 @@
+/*
+    sunkbd - a simulated SUN Type 5 keyboard on a pseudo terminal
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Plays the keyboard's part of the protocol, for testing without one. It
+    creates a pseudo terminal for the other side to open, e.g. sunbridge,
+    or uses a given tty, e.g. the UART pty of simavr running the firmware.
+
+    Like the real thing, it answers the reset command with 0xFF 0x04 0x7F
+    after its self test, or 0x7E 0x01 when the test fails, and the layout
+    command with 0xFE and the DIP switch setting. Makes and breaks are
+    sent as keys go down and up, followed by 0x7F when the last key is up.
+    Bytes go out no faster than at the baud rate, 1200 by default, and the
+    keyboard sends its reset response when powered up, i.e. at start and
+    when plugged back in.
+
+    The script says what happens, one command per line, # for comments:
+
+        wait <ms>              do nothing for a while
+        speed <cps> [hold]     typing speed in chars per second, and how
+                               long keys are held in ms, default 8 and 60
+        jitter <ms>            random variation of typing times
+        type <text>            type text, as on a US keyboard
+        random <n>             type n random letters and digits
+        press <code>           press key with SUN code, e.g. 0x4d for A
+        release <code>         release key
+        tap <code>             press & release key
+        raw <byte>...          send bytes as is
+        garble <percent>       flip a random bit in that many bytes sent
+        selftest pass|fail     outcome of following self tests
+        layout <code>          DIP switch setting sent for layout command
+        unplug                 stop talking, as if unplugged
+        plug                   plug back in, which runs the self test
+        quit                   stop
+
+    Without a script, it just answers commands until interrupted. Commands
+    received and statistics are printed to stderr.
+
+    usage: sunkbd [-v] [-p tty] [-b baud] [-r ms] [-l layout] [script]
+
+        -v         print every command received, and every byte sent
+        -p tty     use tty instead of creating a pseudo terminal
+        -b baud    baud rate, default 1200
+        -r ms      self test time, default 250
+        -l layout  DIP switch setting, default 0 (US)
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <Arduino.h>
+
+#include "layouts.h"
+#include "sun_codes.h"
+#include "sun_to_usb.h"
+
+#define RESET_RESP_2     0x04
+#define SELF_TEST_FAILED 0x7E
+#define SELF_TEST_CODE   0x01
+
+enum ActionType {
+    PRESS, RELEASE, RAW, GARBLE, SELF_TEST, LAYOUT, UNPLUG, PLUG, QUIT
+};
+
+struct Action {
+    uint64_t at; // us after start
+    ActionType type;
+    uint32_t value;
+};
+
+/*
+    What the other side did, and how fast it came up. Startup time is from
+    a reset response to the first LED command after it, i.e. until the
+    adapter was done with its reset.
+ */
+struct Stats {
+    uint32_t resets;
+    uint32_t layouts;
+    uint32_t leds;
+    uint32_t bells;
+    uint32_t clicks;
+    uint32_t unknown;
+    uint32_t keys;
+    uint32_t sent;
+    uint32_t garbled;
+    uint64_t startup;
+    uint64_t maxStartup;
+};
+
+static std::vector<Action> actions;
+static std::vector<uint8_t> txQueue;
+static Stats stats;
+static bool verbose = false;
+static int fd = -1;
+static uint64_t byteTime;
+static uint64_t selfTestTime = 250000;
+
+// keyboard state
+static bool plugged = true;
+static bool selfTestOk = true;
+static uint8_t layout = UNITED_STATES;
+static uint8_t held[16];
+static uint8_t leds = 0;
+static uint8_t garble = 0;      // percent
+static int cmd = -1;            // command waiting for its argument
+static uint64_t selfTestDone = 0; // when the running self test is done, or 0
+static uint64_t resetSent = 0;  // when the last reset response went out
+
+// --- keys ------------------------------------------------------------------
+
+/*
+    SUN codes for USB usages, and for the left Shift, from the sketch's
+    translation table.
+ */
+static uint8_t sunCodes[256];
+static uint8_t shiftCode;
+
+static void initCodes() {
+    for (int k = 127; k > 0; k--) {
+        uint16_t code = pgm_read_word(&sun2usb[k]);
+        if (code == USB_MOD_LSHIFT << 8) {
+            shiftCode = k;
+        } else if (code > 0 && code < 0x100) {
+            sunCodes[code] = k;
+        }
+    }
+}
+
+/*
+    Finds the key for c on a US keyboard. Returns false if there is none.
+ */
+static bool findChar(char c, uint8_t& key, bool& shift) {
+
+    const KeyChars* tables[] = {keys_common, keys_us};
+    const size_t lengths[] = {array_len(keys_common), array_len(keys_us)};
+
+    if (c == '\n') {
+        key = sunCodes[USB_ENTER];
+        shift = false;
+        return key != 0;
+    }
+
+    for (uint8_t t = 0; t < 2; t++) {
+        for (size_t i = 0; i < lengths[t]; i++) {
+            const KeyChars& k = tables[t][i];
+            if (k.base == c || k.shift == c) {
+                key = sunCodes[k.usage];
+                shift = k.base != c;
+                return key != 0;
+            }
+        }
+    }
+    return false;
+}
+
+static bool isHeld(uint8_t key) {
+    return held[key >> 3] & (1 << (key & 0x07));
+}
+
+static bool holdsAny() {
+    for (uint8_t i = 0; i < sizeof(held); i++) {
+        if (held[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// --- line ------------------------------------------------------------------
+
+static void send(uint8_t b) {
+    if (plugged) {
+        txQueue.push_back(b);
+    }
+}
+
+static void sendKey(uint8_t key, bool pressed) {
+    if (pressed == isHeld(key)) {
+        return;
+    }
+    if (pressed) {
+        held[key >> 3] |= 1 << (key & 0x07);
+        stats.keys++;
+        send(key);
+    } else {
+        held[key >> 3] &= ~(1 << (key & 0x07));
+        send(key | BREAK_BIT);
+        if (!holdsAny()) {
+            send(KBD_IDLE);
+        }
+    }
+}
+
+/*
+    Self test starts on reset and power up. Keys held through it are lost,
+    except that the response reports the first one still down.
+ */
+static void startSelfTest(uint64_t now) {
+    txQueue.clear();
+    cmd = -1;
+    selfTestDone = now + selfTestTime;
+    resetSent = 0;
+}
+
+static void finishSelfTest(uint64_t now) {
+
+    selfTestDone = 0;
+
+    if (!selfTestOk) {
+        send(SELF_TEST_FAILED);
+        send(SELF_TEST_CODE);
+        return;
+    }
+
+    send(KBD_RESET_RESP);
+    send(RESET_RESP_2);
+    uint8_t key = KBD_IDLE;
+    for (uint8_t k = 1; k < 128 && key == KBD_IDLE; k++) {
+        if (isHeld(k)) {
+            key = k;
+        }
+    }
+    send(key);
+    resetSent = now;
+}
+
+static void handleCommand(uint8_t b, uint64_t now) {
+
+    if (!plugged) {
+        return;
+    }
+
+    if (cmd == CMD_LED) {
+        cmd = -1;
+        leds = b;
+        stats.leds++;
+        if (resetSent > 0) {
+            uint64_t t = now - resetSent;
+            stats.startup = t;
+            stats.maxStartup = max(stats.maxStartup, t);
+            resetSent = 0;
+        }
+        if (verbose) {
+            fprintf(stderr, "sunkbd: %8.3f LEDs %02x\n", now / 1e3, b);
+        }
+        return;
+    }
+
+    const char* name = NULL;
+    switch (b) {
+        case CMD_RESET:
+            stats.resets++;
+            name = "reset";
+            startSelfTest(now);
+            break;
+        case CMD_LAYOUT:
+            stats.layouts++;
+            name = "layout";
+            send(KBD_LAYOUT_RESP);
+            send(layout);
+            break;
+        case CMD_LED:
+            cmd = CMD_LED;
+            return;
+        case CMD_BELL_ON:
+        case CMD_BELL_OFF:
+            stats.bells += b == CMD_BELL_ON;
+            name = b == CMD_BELL_ON ? "bell on" : "bell off";
+            break;
+        case CMD_CLICK_ON:
+        case CMD_CLICK_OFF:
+            stats.clicks += b == CMD_CLICK_ON;
+            name = b == CMD_CLICK_ON ? "click on" : "click off";
+            break;
+        default:
+            stats.unknown++;
+            fprintf(stderr, "sunkbd: %8.3f unknown command %02x\n",
+                now / 1e3, b);
+            return;
+    }
+
+    if (verbose) {
+        fprintf(stderr, "sunkbd: %8.3f %s\n", now / 1e3, name);
+    }
+}
+
+static void transmit(uint64_t now) {
+
+    uint8_t b = txQueue.front();
+    txQueue.erase(txQueue.begin());
+
+    if (garble > 0 && (uint8_t)(random() % 100) < garble) {
+        b ^= 1 << (random() % 8);
+        stats.garbled++;
+    }
+    if (verbose) {
+        fprintf(stderr, "sunkbd: %8.3f sent %02x\n", now / 1e3, b);
+    }
+    if (write(fd, &b, 1) == 1) {
+        stats.sent++;
+    }
+}
+
+// --- script ----------------------------------------------------------------
+
+static uint64_t jitter(uint32_t ms) {
+    return ms > 0 ? (random() % (2 * ms * 1000)) : 0;
+}
+
+static void add(uint64_t at, ActionType type, uint32_t value = 0) {
+    Action a = {at, type, value};
+    actions.push_back(a);
+}
+
+/*
+    Adds the actions for typing c at at, returns when the next key can go.
+ */
+static uint64_t typeChar(uint64_t at, char c, uint32_t cps, uint32_t hold,
+    uint32_t jit) {
+
+    uint8_t key;
+    bool shift;
+    if (!findChar(c, key, shift)) {
+        fprintf(stderr, "sunkbd: can't type %c\n", c);
+        return at;
+    }
+
+    uint64_t down = hold * 1000 + jitter(jit);
+    if (shift) {
+        add(at, PRESS, shiftCode);
+    }
+    add(at, PRESS, key);
+    add(at + down, RELEASE, key);
+    if (shift) {
+        add(at + down, RELEASE, shiftCode);
+    }
+    return at + max(1000000 / cps + jitter(jit), down + 1000);
+}
+
+static bool parseScript(FILE* f) {
+
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    char line[1024];
+    uint32_t cps = 8, hold = 60, jit = 0;
+    uint64_t at = 0;
+    int n = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+
+        n++;
+        char* nl = strchr(line, '\n');
+        if (nl != NULL) {
+            *nl = 0;
+        }
+
+        char word[16];
+        int skip = 0;
+        if (sscanf(line, " %15s %n", word, &skip) < 1 || word[0] == '#') {
+            continue;
+        }
+        char* arg = line + skip;
+        unsigned long v = strtoul(arg, NULL, 0);
+
+        if (!strcmp(word, "wait")) {
+            at += v * 1000;
+        } else if (!strcmp(word, "speed")) {
+            sscanf(arg, "%u %u", &cps, &hold);
+            cps = max(cps, 1U);
+        } else if (!strcmp(word, "jitter")) {
+            jit = v;
+        } else if (!strcmp(word, "type")) {
+            for (char* c = arg; *c; c++) {
+                at = typeChar(at, *c, cps, hold, jit);
+            }
+        } else if (!strcmp(word, "random")) {
+            for (unsigned long i = 0; i < v; i++) {
+                at = typeChar(at, chars[random() % (sizeof(chars) - 1)],
+                    cps, hold, jit);
+            }
+        } else if (!strcmp(word, "press")) {
+            add(at, PRESS, v & 0x7F);
+        } else if (!strcmp(word, "release")) {
+            add(at, RELEASE, v & 0x7F);
+        } else if (!strcmp(word, "tap")) {
+            add(at, PRESS, v & 0x7F);
+            at += hold * 1000;
+            add(at, RELEASE, v & 0x7F);
+        } else if (!strcmp(word, "raw")) {
+            char* end;
+            for (char* p = arg; ; p = end) {
+                unsigned long b = strtoul(p, &end, 0);
+                if (end == p) {
+                    break;
+                }
+                add(at, RAW, b & 0xFF);
+            }
+        } else if (!strcmp(word, "garble")) {
+            add(at, GARBLE, min(v, 100UL));
+        } else if (!strcmp(word, "selftest")) {
+            add(at, SELF_TEST, strncmp(arg, "fail", 4) != 0);
+        } else if (!strcmp(word, "layout")) {
+            add(at, LAYOUT, v & 0xFF);
+        } else if (!strcmp(word, "unplug")) {
+            add(at, UNPLUG);
+        } else if (!strcmp(word, "plug")) {
+            add(at, PLUG);
+        } else if (!strcmp(word, "quit")) {
+            add(at, QUIT);
+        } else {
+            fprintf(stderr, "sunkbd: line %d: unknown command %s\n", n, word);
+            return false;
+        }
+    }
+
+    add(at, QUIT);
+    return true;
+}
+
+/*
+    Returns false when it's time to stop.
+ */
+static bool run(const Action& a, uint64_t now) {
+
+    switch (a.type) {
+        case PRESS:
+        case RELEASE:
+            sendKey(a.value, a.type == PRESS);
+            break;
+        case RAW:
+            send(a.value);
+            break;
+        case GARBLE:
+            garble = a.value;
+            break;
+        case SELF_TEST:
+            selfTestOk = a.value;
+            break;
+        case LAYOUT:
+            layout = a.value;
+            break;
+        case UNPLUG:
+            plugged = false;
+            txQueue.clear();
+            selfTestDone = 0;
+            memset(held, 0, sizeof(held));
+            fprintf(stderr, "sunkbd: %8.3f unplugged\n", now / 1e3);
+            break;
+        case PLUG:
+            if (!plugged) {
+                plugged = true;
+                fprintf(stderr, "sunkbd: %8.3f plugged in\n", now / 1e3);
+                startSelfTest(now);
+            }
+            break;
+        case QUIT:
+            return false;
+    }
+    return true;
+}
+
+// --- main ------------------------------------------------------------------
+
+static volatile bool running = true;
+
+static void stop(int sig) {
+    running = false;
+}
+
+static void printStats(uint64_t now) {
+    fprintf(stderr, "sunkbd: %.3fs, %u bytes sent, %u garbled, %u keys, "
+        "%.1f keys/s\n", now / 1e6, stats.sent, stats.garbled, stats.keys,
+        now > 0 ? stats.keys * 1e6 / now : 0.0);
+    fprintf(stderr, "sunkbd: received %u resets, %u layout, %u LED, %u bell, "
+        "%u click, %u unknown commands\n", stats.resets, stats.layouts,
+        stats.leds, stats.bells, stats.clicks, stats.unknown);
+    fprintf(stderr, "sunkbd: startup %.1fms, max %.1fms\n",
+        stats.startup / 1e3, stats.maxStartup / 1e3);
+}
+
+static int openLine(const char* path) {
+
+    int f;
+    if (path != NULL) {
+        f = open(path, O_RDWR | O_NOCTTY);
+    } else {
+        f = posix_openpt(O_RDWR | O_NOCTTY);
+        if (f >= 0 && (grantpt(f) < 0 || unlockpt(f) < 0)) {
+            close(f);
+            f = -1;
+        }
+    }
+    if (f < 0) {
+        perror("sunkbd: opening line");
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(f, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(f, TCSANOW, &tio);
+    }
+
+    if (path == NULL) {
+        printf("%s\n", ptsname(f));
+        fflush(stdout);
+    }
+    return f;
+}
+
+int main(int argc, char** argv) {
+
+    const char* path = NULL;
+    uint32_t baud = 1200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vp:b:r:l:")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+            case 'p':
+                path = optarg;
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            case 'r':
+                selfTestTime = atol(optarg) * 1000;
+                break;
+            case 'l':
+                layout = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v] [-p tty] [-b baud] [-r ms] "
+                    "[-l layout] [script]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (baud == 0) {
+        fprintf(stderr, "sunkbd: invalid baud rate\n");
+        return 1;
+    }
+    // start bit, 8 data bits, stop bit
+    byteTime = 10 * 1000000ULL / baud;
+
+    initCodes();
+    if (optind < argc) {
+        FILE* f = fopen(argv[optind], "r");
+        if (f == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+        bool ok = parseScript(f);
+        fclose(f);
+        if (!ok) {
+            return 1;
+        }
+    }
+
+    fd = openLine(path);
+    if (fd < 0) {
+        return 1;
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    uint64_t start = hostTime();
+    uint64_t nextByte = 0;
+    size_t next = 0;
+    startSelfTest(0); // powering up
+
+    while (running) {
+
+        uint64_t now = hostTime() - start;
+
+        if (selfTestDone > 0 && now >= selfTestDone) {
+            finishSelfTest(now);
+        }
+
+        // a script only ends once everything has gone out
+        while (next < actions.size() && now >= actions[next].at &&
+            (actions[next].type != QUIT || txQueue.empty())) {
+            running &= run(actions[next++], now);
+        }
+
+        if (!txQueue.empty() && now >= nextByte) {
+            transmit(now);
+            nextByte = max(nextByte, now) + byteTime;
+        }
+
+        // sleep until the next thing is due, or a command comes in
+        uint64_t due = now + 1000000;
+        if (selfTestDone > 0) {
+            due = min(due, selfTestDone);
+        }
+        if (next < actions.size()) {
+            due = min(due, actions[next].at);
+        }
+        if (!txQueue.empty()) {
+            due = min(due, nextByte);
+        }
+
+        struct pollfd p = {fd, POLLIN, 0};
+        int timeout = due > now ? (due - now + 999) / 1000 : 0;
+        if (poll(&p, 1, timeout) > 0) {
+            if (p.revents & POLLIN) {
+                uint8_t buf[64];
+                ssize_t n = read(fd, buf, sizeof(buf));
+                now = hostTime() - start;
+                for (ssize_t i = 0; i < n; i++) {
+                    handleCommand(buf[i], now);
+                }
+            } else if (p.revents & POLLHUP) {
+                // nobody on the other end of the pseudo terminal yet
+                usleep(min(timeout, 10) * 1000);
+            }
+        }
+    }
+
+    printStats(hostTime() - start);
+    return 0;
+}
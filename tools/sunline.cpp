@@ -0,0 +1,565 @@
+/*
+    sunline - bit level simulation of the keyboard & mouse serial lines
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Turns bytes into the signal on the line, makes that signal worse, and
+    decodes it again the way the adapter does, to see how much the line
+    can take before bytes get lost or garbled.
+
+    The signal is a list of times at which the line toggles. It's either
+    rendered from a byte file, e.g. from sunmouse -o, or read from a VCD
+    file, e.g. recorded with a logic analyzer (for sigrok captures, export
+    with sigrok-cli -O vcd). Then, as set by the options, the sender's
+    clock is off, edges jitter, rising and falling edges are delayed by
+    slow slopes, and glitches are added.
+
+    The keyboard is read with SoftwareSerial: a pin change interrupt on the
+    start bit, after which each bit is sampled once, timed from the
+    interrupt, which may come late when interrupts are off elsewhere. The
+    mouse is read with the USART, which takes the majority of three samples
+    in the middle of each bit, on a 16x clock, and checks the stop bit.
+
+    When rendered from bytes, decoded bytes are matched with sent ones to
+    count lost, garbled, and spurious bytes, and latency is the time from
+    the end of the last data bit to the byte being available. The final
+    signal can be written as VCD, e.g. for simavr or a waveform viewer, and
+    the decoded bytes as a byte file, e.g. for sunscan.
+
+    usage: sunline [options] (-b file | -v file)
+
+        -b file    render bytes from file
+        -v file    read signal from VCD file
+        -n name    signal in VCD file, default is the first one
+        -u         decode with USART, otherwise with SoftwareSerial
+        -2         two stop bits, as for the mouse
+        -i         signal is inverted, as on the wire
+        -r baud    baud rate, default 1200
+        -k ppm     sender's clock is off by that much
+        -j us      jitter of edges, standard deviation
+        -s us,us   rise and fall time
+        -g rate,us glitches per second, and their length
+        -l us,us   interrupt latency, fixed and random, SoftwareSerial only
+        -o file    write signal to VCD file
+        -w file    write decoded bytes to file
+        -x seed    seed for randomness
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#define LEAD_BITS 20 // idle before the first byte
+
+/*
+    The line, as seen by the receiver after any inverter: starts at level
+    first and toggles at the given times, in microseconds.
+ */
+struct Signal {
+    bool first;
+    std::vector<double> toggles;
+
+    bool level(double t) const {
+        size_t n = std::upper_bound(toggles.begin(), toggles.end(), t) -
+            toggles.begin();
+        return first ^ (n & 1);
+    }
+
+    // first time after t at which the line goes from 1 to 0, or -1
+    double nextFall(double t) const {
+        size_t i = std::upper_bound(toggles.begin(), toggles.end(), t) -
+            toggles.begin();
+        for (; i < toggles.size(); i++) {
+            if ((first ^ ((i + 1) & 1)) == 0) {
+                return toggles[i];
+            }
+        }
+        return -1;
+    }
+
+    double end() const {
+        return toggles.empty() ? 0 : toggles.back();
+    }
+};
+
+struct Decoded {
+    double start;   // of the start bit, as the receiver saw it
+    double ready;   // when the byte was available
+    uint8_t value;
+    bool frameError;
+};
+
+struct Options {
+    double baud = 1200;
+    uint8_t stopBits = 1;
+    bool usart = false;
+    bool inverted = false;
+    double skew = 0;        // ppm
+    double jitter = 0;      // us
+    double rise = 0;        // us
+    double fall = 0;        // us
+    double glitchRate = 0;  // per second
+    double glitchLength = 0;
+    double latency = 4;     // us
+    double latencyRandom = 0;
+};
+
+static Options opts;
+
+// --- randomness ------------------------------------------------------------
+
+static uint64_t seed = 0x2545F4914F6CDD1DULL;
+
+static double uniform() {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian(double sigma) {
+    if (sigma <= 0) {
+        return 0;
+    }
+    double u = std::max(uniform(), 1e-12);
+    return sigma * sqrt(-2 * log(u)) * cos(2 * M_PI * uniform());
+}
+
+// --- signal ----------------------------------------------------------------
+
+/*
+    Renders bytes back to back, after some idle time. Returns when each
+    byte started. Slopes delay edges by half their time, i.e. until they
+    cross the middle.
+ */
+static std::vector<double> render(const std::vector<uint8_t>& bytes,
+    Signal& s) {
+
+    double bit = 1e6 / opts.baud * (1 + opts.skew / 1e6);
+    double t = LEAD_BITS * bit;
+    bool level = true;
+    std::vector<double> starts;
+
+    s.first = true;
+    s.toggles.clear();
+
+    for (size_t i = 0; i < bytes.size(); i++) {
+        starts.push_back(t);
+        uint16_t frame = (bytes[i] << 1) | (0xFFFF << 9); // start bit is 0
+        for (uint8_t b = 0; b < 9 + opts.stopBits; b++) {
+            bool now = (frame >> b) & 1;
+            if (now != level) {
+                double slope = now ? opts.rise : opts.fall;
+                s.toggles.push_back(t + slope / 2 + gaussian(opts.jitter));
+                level = now;
+            }
+            t += bit;
+        }
+    }
+
+    // jitter may have swapped edges, which then just make a short pulse
+    std::sort(s.toggles.begin(), s.toggles.end());
+    return starts;
+}
+
+/*
+    Glitches flip the line for a moment, at random times.
+ */
+static void addGlitches(Signal& s) {
+
+    if (opts.glitchRate <= 0) {
+        return;
+    }
+
+    double end = s.end() + 1e6 / opts.baud * LEAD_BITS;
+    for (double t = 0; ; ) {
+        t += -log(std::max(uniform(), 1e-12)) * 1e6 / opts.glitchRate;
+        if (t >= end) {
+            break;
+        }
+        s.toggles.push_back(t);
+        s.toggles.push_back(t + opts.glitchLength);
+    }
+    std::sort(s.toggles.begin(), s.toggles.end());
+}
+
+/*
+    Reads the first, or the named, single bit signal from a VCD file.
+ */
+static bool readVCD(const char* path, const char* name, Signal& s) {
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char tok[256];
+    char id[64] = "";
+    double scale = 1e-3; // VCD default is 1ns, we use us
+    double now = 0;
+    bool known = false;
+    bool level = false;
+
+    s.toggles.clear();
+
+    while (fscanf(f, "%255s", tok) == 1) {
+        if (!strcmp(tok, "$timescale")) {
+            double v = 1;
+            char unit[16] = "";
+            if (fscanf(f, "%255s", tok) == 1) {
+                // either "10ns" or "10 ns"
+                if (sscanf(tok, "%lf%15s", &v, unit) < 2) {
+                    fscanf(f, "%15s", unit);
+                }
+            }
+            double u = !strcmp(unit, "s") ? 1e6 : !strcmp(unit, "ms") ? 1e3 :
+                !strcmp(unit, "us") ? 1 : !strcmp(unit, "ns") ? 1e-3 :
+                !strcmp(unit, "ps") ? 1e-6 : 1e-9;
+            scale = v * u;
+        } else if (!strcmp(tok, "$var")) {
+            char type[32], ref[64], sig[128];
+            int width;
+            if (fscanf(f, "%31s %d %63s %127s", type, &width, ref, sig) == 4 &&
+                width == 1 && id[0] == 0 && (name == NULL ||
+                !strcmp(sig, name))) {
+                strcpy(id, ref);
+            }
+        } else if (tok[0] == '#') {
+            now = atof(tok + 1) * scale;
+        } else if ((tok[0] == '0' || tok[0] == '1') && id[0] != 0 &&
+            !strcmp(tok + 1, id)) {
+            bool v = tok[0] == '1';
+            if (!known) {
+                s.first = v;
+                known = true;
+            } else if (v != level) {
+                s.toggles.push_back(now);
+            }
+            level = v;
+        }
+    }
+
+    fclose(f);
+    if (!known) {
+        fprintf(stderr, "sunline: %s: no such signal\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool writeVCD(const char* path, const Signal& s) {
+
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    bool inv = opts.inverted;
+    fprintf(f, "$timescale 1ns $end\n$scope module sunline $end\n"
+        "$var wire 1 ! rx $end\n$upscope $end\n$enddefinitions $end\n"
+        "#0\n%d!\n", s.first ^ inv);
+    bool level = s.first;
+    for (size_t i = 0; i < s.toggles.size(); i++) {
+        level = !level;
+        fprintf(f, "#%lld\n%d!\n", llround(s.toggles[i] * 1000), level ^ inv);
+    }
+
+    fclose(f);
+    return true;
+}
+
+// --- receivers -------------------------------------------------------------
+
+/*
+    SoftwareSerial: the pin change interrupt comes in after some latency,
+    and goes away if the line isn't low by then. Bits are sampled once,
+    with the delays calibrated for the typical latency. The stop bit isn't
+    checked, the interrupt is back on three quarters into it. Edges in the
+    meantime leave the interrupt flag set, so it fires right away then.
+ */
+static std::vector<Decoded> decodeSoftware(const Signal& s) {
+
+    std::vector<Decoded> out;
+    double bit = 1e6 / opts.baud;
+    double from = 0;
+    bool pending = false;
+
+    for (;;) {
+        double edge = pending ? from : s.nextFall(from);
+        if (edge < 0) {
+            break;
+        }
+        double isr = edge + opts.latency + uniform() * opts.latencyRandom;
+        pending = false;
+        if (s.level(isr)) {
+            from = isr;
+            continue;
+        }
+
+        Decoded d;
+        d.start = edge;
+        d.value = 0;
+        d.frameError = false;
+        double centre = isr - opts.latency + bit / 2;
+        for (uint8_t b = 0; b < 8; b++) {
+            if (s.level(centre + (b + 1) * bit)) {
+                d.value |= 1 << b;
+            }
+        }
+        d.ready = centre + 8 * bit + bit * 3 / 4;
+        out.push_back(d);
+
+        from = d.ready;
+        pending = s.level(from) == 0 &&
+            std::upper_bound(s.toggles.begin(), s.toggles.end(), edge) !=
+            std::upper_bound(s.toggles.begin(), s.toggles.end(), from);
+    }
+    return out;
+}
+
+/*
+    USART: looks for a falling edge on a free running 16x sample clock,
+    then takes the majority of samples 8, 9, and 10 of each bit. A start
+    bit that's high by then was noise. A low stop bit is a frame error,
+    but the byte is still there. Only the first stop bit is checked.
+ */
+static bool majority(const Signal& s, double t, double tick) {
+    return s.level(t + 7 * tick) + s.level(t + 8 * tick) +
+        s.level(t + 9 * tick) >= 2;
+}
+
+static std::vector<Decoded> decodeUSART(const Signal& s) {
+
+    std::vector<Decoded> out;
+    // 16 MHz, U2X off, rounded UBRR
+    double ubrr = round(16e6 / (16 * opts.baud)) - 1;
+    double tick = (ubrr + 1) / 16e6 * 1e6;
+    double from = 0;
+
+    for (;;) {
+        double edge = s.nextFall(from);
+        if (edge < 0) {
+            break;
+        }
+        double t = ceil(edge / tick) * tick; // first sample that sees it
+
+        if (majority(s, t, tick)) {
+            from = t + 9 * tick;
+            continue;
+        }
+
+        Decoded d;
+        d.start = t;
+        d.value = 0;
+        for (uint8_t b = 0; b < 8; b++) {
+            if (majority(s, t + (b + 1) * 16 * tick, tick)) {
+                d.value |= 1 << b;
+            }
+        }
+        d.frameError = !majority(s, t + 9 * 16 * tick, tick);
+        d.ready = t + (9 * 16 + 9) * tick;
+        out.push_back(d);
+
+        // after a frame error, the line may be low already
+        // from there on, it needs to see the line go high and low again
+        from = d.ready;
+        if (!s.level(from)) {
+            size_t i = std::upper_bound(s.toggles.begin(), s.toggles.end(),
+                from) - s.toggles.begin();
+            if (i == s.toggles.size()) {
+                break;
+            }
+            from = s.toggles[i];
+        }
+    }
+    return out;
+}
+
+// --- main ------------------------------------------------------------------
+
+/*
+    Matches decoded bytes with sent ones by start time, and prints counts.
+ */
+static void compare(const std::vector<uint8_t>& sent,
+    const std::vector<double>& starts, const std::vector<Decoded>& got) {
+
+    double bit = 1e6 / opts.baud * (1 + opts.skew / 1e6);
+    double frame = (9 + opts.stopBits) * bit;
+    std::vector<bool> matched(sent.size(), false);
+    uint64_t ok = 0, garbled = 0, spurious = 0, errors = 0;
+    double sum = 0, worst = 0;
+
+    size_t i = 0;
+    for (size_t k = 0; k < got.size(); k++) {
+        const Decoded& d = got[k];
+        errors += d.frameError;
+        while (i < starts.size() && starts[i] + frame / 2 < d.start) {
+            i++;
+        }
+        // start seen up to half a frame early or late
+        size_t j = i > 0 && d.start - starts[i - 1] < frame / 2 ? i - 1 : i;
+        if (j >= starts.size() || fabs(d.start - starts[j]) >= frame / 2 ||
+            matched[j]) {
+            spurious++;
+            continue;
+        }
+        matched[j] = true;
+        if (d.value != sent[j]) {
+            garbled++;
+            continue;
+        }
+        ok++;
+        double latency = d.ready - (starts[j] + 9 * bit);
+        sum += latency;
+        worst = std::max(worst, latency);
+    }
+
+    uint64_t lost = sent.size() - ok - garbled;
+    printf("sent %zu, ok %llu, garbled %llu, lost %llu, spurious %llu, "
+        "frame errors %llu\n", sent.size(), (unsigned long long)ok,
+        (unsigned long long)garbled, (unsigned long long)lost,
+        (unsigned long long)spurious, (unsigned long long)errors);
+    printf("byte error rate %.3g, latency avg %.1fus, max %.1fus\n",
+        sent.empty() ? 0.0 : (double)(sent.size() - ok) / sent.size(),
+        ok > 0 ? sum / ok : 0.0, worst);
+}
+
+static bool pair(const char* arg, double& a, double& b) {
+    return sscanf(arg, "%lf,%lf", &a, &b) >= 1;
+}
+
+int main(int argc, char** argv) {
+
+    const char* bytesPath = NULL;
+    const char* vcdPath = NULL;
+    const char* name = NULL;
+    const char* vcdOut = NULL;
+    const char* bytesOut = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:v:n:u2ir:k:j:s:g:l:o:w:x:")) != -1) {
+        bool ok = true;
+        switch (opt) {
+            case 'b': bytesPath = optarg; break;
+            case 'v': vcdPath = optarg; break;
+            case 'n': name = optarg; break;
+            case 'u': opts.usart = true; break;
+            case '2': opts.stopBits = 2; break;
+            case 'i': opts.inverted = true; break;
+            case 'r': opts.baud = atof(optarg); ok = opts.baud > 0; break;
+            case 'k': opts.skew = atof(optarg); break;
+            case 'j': opts.jitter = atof(optarg); break;
+            case 's': ok = pair(optarg, opts.rise, opts.fall); break;
+            case 'g':
+                ok = pair(optarg, opts.glitchRate, opts.glitchLength);
+                break;
+            case 'l':
+                ok = pair(optarg, opts.latency, opts.latencyRandom);
+                break;
+            case 'o': vcdOut = optarg; break;
+            case 'w': bytesOut = optarg; break;
+            case 'x': seed = strtoull(optarg, NULL, 0) | 1; break;
+            default: ok = false;
+        }
+        if (!ok) {
+            bytesPath = vcdPath = NULL;
+            break;
+        }
+    }
+
+    if ((bytesPath == NULL) == (vcdPath == NULL)) {
+        fprintf(stderr, "usage: %s [-u] [-2] [-i] [-r baud] [-k ppm] [-j us] "
+            "[-s rise,fall] [-g rate,us] [-l us,us] [-n name] [-o vcd] "
+            "[-w file] [-x seed] (-b file | -v vcd)\n", argv[0]);
+        return 1;
+    }
+
+    Signal s;
+    std::vector<uint8_t> sent;
+    std::vector<double> starts;
+
+    if (bytesPath != NULL) {
+        FILE* f = fopen(bytesPath, "rb");
+        if (f == NULL) {
+            perror(bytesPath);
+            return 1;
+        }
+        int c;
+        while ((c = fgetc(f)) != EOF) {
+            sent.push_back(c);
+        }
+        fclose(f);
+        starts = render(sent, s);
+    } else {
+        if (!readVCD(vcdPath, name, s)) {
+            return 1;
+        }
+        if (opts.inverted) {
+            s.first = !s.first;
+        }
+        // slopes & jitter on recorded edges, directions are known
+        for (size_t i = 0; i < s.toggles.size(); i++) {
+            bool rising = s.first ^ (i & 1) ^ 1;
+            s.toggles[i] += (rising ? opts.rise : opts.fall) / 2 +
+                gaussian(opts.jitter);
+        }
+        std::sort(s.toggles.begin(), s.toggles.end());
+    }
+
+    addGlitches(s);
+
+    if (vcdOut != NULL && !writeVCD(vcdOut, s)) {
+        return 1;
+    }
+
+    std::vector<Decoded> got = opts.usart ? decodeUSART(s) :
+        decodeSoftware(s);
+
+    if (bytesOut != NULL) {
+        FILE* f = fopen(bytesOut, "wb");
+        if (f == NULL) {
+            perror(bytesOut);
+            return 1;
+        }
+        for (size_t i = 0; i < got.size(); i++) {
+            fputc(got[i].value, f);
+        }
+        fclose(f);
+    }
+
+    if (bytesPath != NULL) {
+        compare(sent, starts, got);
+    } else {
+        uint64_t errors = 0;
+        for (size_t i = 0; i < got.size(); i++) {
+            errors += got[i].frameError;
+        }
+        printf("decoded %zu, frame errors %llu\n", got.size(),
+            (unsigned long long)errors);
+    }
+    return 0;
+}
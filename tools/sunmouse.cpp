@@ -0,0 +1,543 @@
+/*
+    sunmouse - a simulated SUN serial mouse
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Sends what a mouse would, in either the 5-byte Mousesystems or the
+    3-byte SUN protocol (see mouse.cpp), for testing without one. Like the
+    real mouse, it sends frames back to back while it's moved or buttons
+    change, one byte every 11 bit times.
+
+    Output goes to a pseudo terminal it creates, or a given tty, e.g. for
+    sunbridge or simavr, in real time. With -o, it goes to a file instead,
+    as fast as it can be generated, e.g. for sunscan -m, which then tells
+    how fast the converter handles it, and how long resyncing took.
+
+    The script says what happens, one command per line, # for comments:
+
+        wait <ms>              do nothing for a while
+        protocol 3|5           protocol to use, default 5
+        move <dx> <dy> <ms>    move by dx & dy, evenly over ms
+        speed <px/s>           speed for wander, default 400
+        wander <ms>            move around randomly for a while
+        play <file>            play a recorded path, lines of
+                               <ms> <dx> <dy> [buttons], ms from start
+        buttons <lmr>          hold these buttons, e.g. lm, or - for none
+        noise <counts>         add up to that much sensor noise to motion
+        drop <percent>         drop that many bytes
+        garbage <percent>      insert that many random bytes
+        unplug                 stop sending, cutting off the current frame
+        plug                   plug back in
+        quit                   stop
+
+    Statistics about what was sent go to stderr at the end, so they can be
+    compared with what came out of the converter.
+
+    usage: sunmouse [-v] [-p tty | -o file] [-b baud] [-s seed] script
+
+        -v         print every byte sent
+        -p tty     use tty instead of creating a pseudo terminal
+        -o file    write to file, not in real time
+        -b baud    baud rate, default 1200
+        -s seed    seed for randomness, for repeatable runs
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <Arduino.h>
+
+#include "mouse.h"
+
+#define STEP        10000 // us, granularity of motion
+#define BUTTON_L    0x04  // as in the protocol, where they're low active
+#define BUTTON_M    0x02
+#define BUTTON_R    0x01
+
+enum ActionType {
+    MOTION, BUTTONS, PROTOCOL, NOISE, DROP, GARBAGE, UNPLUG, PLUG, QUIT
+};
+
+struct Action {
+    uint64_t at; // us after start
+    ActionType type;
+    int32_t x;
+    int32_t y;
+};
+
+struct Stats {
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t dropped;
+    uint64_t garbage;
+    uint64_t cut;     // frames cut off by unplugging
+    int64_t dx;       // motion in frames without dropped bytes
+    int64_t dy;
+    uint32_t clicks;  // button changes
+    uint32_t unplugs;
+};
+
+static std::vector<Action> actions;
+static Stats stats;
+static bool verbose = false;
+
+// mouse state
+static bool fiveBytes = true;
+static bool plugged = true;
+static uint8_t buttons = 0;     // held, protocol bits but high active
+static uint8_t sentButtons = 0;
+static double restX = 0;        // motion not sent yet
+static double restY = 0;
+static uint8_t noise = 0;
+static uint8_t drop = 0;
+static uint8_t garbage = 0;
+static uint8_t frame[5];
+static uint8_t frameLen = 0;
+static uint8_t frameIx = 0;
+static int64_t frameX = 0;      // motion in frame being sent
+static int64_t frameY = 0;
+static bool frameBroken = false;
+
+// --- script ----------------------------------------------------------------
+
+static void add(uint64_t at, ActionType type, int32_t x = 0, int32_t y = 0) {
+    Action a = {at, type, x, y};
+    actions.push_back(a);
+}
+
+/*
+    Motion is added in steps, in 1/256 counts, so slow moves add up.
+ */
+static void addMove(uint64_t at, double dx, double dy, uint64_t duration) {
+    uint64_t steps = max(duration / STEP, (uint64_t)1);
+    for (uint64_t i = 0; i < steps; i++) {
+        add(at + i * STEP, MOTION, lround(dx * 256 / steps),
+            lround(dy * 256 / steps));
+    }
+}
+
+static int32_t parseButtons(const char* s) {
+    int32_t b = 0;
+    b |= strchr(s, 'l') != NULL ? BUTTON_L : 0;
+    b |= strchr(s, 'm') != NULL ? BUTTON_M : 0;
+    b |= strchr(s, 'r') != NULL ? BUTTON_R : 0;
+    return b;
+}
+
+static bool playPath(const char* path, uint64_t& at) {
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char line[256];
+    uint64_t end = at;
+    int32_t last = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long ms;
+        int dx, dy;
+        char b[8] = "";
+        if (line[0] == '#' || sscanf(line, "%lu %d %d %7s", &ms, &dx, &dy,
+            b) < 3) {
+            continue;
+        }
+        end = at + ms * 1000;
+        add(end, MOTION, dx * 256, dy * 256);
+        int32_t now = parseButtons(b);
+        if (now != last) {
+            add(end, BUTTONS, now);
+            last = now;
+        }
+    }
+
+    fclose(f);
+    at = end;
+    return true;
+}
+
+static bool parseScript(FILE* f) {
+
+    char line[1024];
+    uint64_t at = 0;
+    double speed = 400;
+    int n = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+
+        n++;
+        char* nl = strchr(line, '\n');
+        if (nl != NULL) {
+            *nl = 0;
+        }
+
+        char word[16];
+        int skip = 0;
+        if (sscanf(line, " %15s %n", word, &skip) < 1 || word[0] == '#') {
+            continue;
+        }
+        char* arg = line + skip;
+        long v = strtol(arg, NULL, 0);
+
+        if (!strcmp(word, "wait")) {
+            at += v * 1000;
+        } else if (!strcmp(word, "protocol")) {
+            add(at, PROTOCOL, v == 3 ? 3 : 5);
+        } else if (!strcmp(word, "move")) {
+            long dx = 0, dy = 0, ms = 0;
+            sscanf(arg, "%ld %ld %ld", &dx, &dy, &ms);
+            addMove(at, dx, dy, ms * 1000);
+            at += ms * 1000;
+        } else if (!strcmp(word, "speed")) {
+            speed = max(v, 1L);
+        } else if (!strcmp(word, "wander")) {
+            // straight stretches of 50 to 250ms in random directions
+            for (uint64_t end = at + v * 1000; at < end; ) {
+                uint64_t d = min((uint64_t)(50 + random() % 200) * 1000,
+                    end - at);
+                double a = random() * 2 * M_PI / RAND_MAX;
+                double dist = speed * d / 1e6;
+                addMove(at, dist * cos(a), dist * sin(a), d);
+                at += d;
+            }
+        } else if (!strcmp(word, "play")) {
+            if (!playPath(arg, at)) {
+                return false;
+            }
+        } else if (!strcmp(word, "buttons")) {
+            add(at, BUTTONS, parseButtons(arg));
+        } else if (!strcmp(word, "noise")) {
+            add(at, NOISE, min(max(v, 0L), 127L));
+        } else if (!strcmp(word, "drop")) {
+            add(at, DROP, min(max(v, 0L), 100L));
+        } else if (!strcmp(word, "garbage")) {
+            add(at, GARBAGE, min(max(v, 0L), 100L));
+        } else if (!strcmp(word, "unplug")) {
+            add(at, UNPLUG);
+        } else if (!strcmp(word, "plug")) {
+            add(at, PLUG);
+        } else if (!strcmp(word, "quit")) {
+            add(at, QUIT);
+        } else {
+            fprintf(stderr, "sunmouse: line %d: unknown command %s\n", n,
+                word);
+            return false;
+        }
+    }
+
+    add(at, QUIT);
+    return true;
+}
+
+// --- mouse -----------------------------------------------------------------
+
+/*
+    Returns false when it's time to stop.
+ */
+static bool run(const Action& a) {
+
+    switch (a.type) {
+        case MOTION:
+            restX += a.x / 256.0;
+            restY += a.y / 256.0;
+            break;
+        case BUTTONS:
+            buttons = a.x;
+            break;
+        case PROTOCOL:
+            fiveBytes = a.x == 5;
+            break;
+        case NOISE:
+            noise = a.x;
+            break;
+        case DROP:
+            drop = a.x;
+            break;
+        case GARBAGE:
+            garbage = a.x;
+            break;
+        case UNPLUG:
+            if (plugged) {
+                plugged = false;
+                stats.unplugs++;
+                if (frameIx > 0 && frameIx < frameLen) {
+                    stats.cut++;
+                }
+                frameLen = frameIx = 0;
+            }
+            break;
+        case PLUG:
+            plugged = true;
+            break;
+        case QUIT:
+            return false;
+    }
+    return true;
+}
+
+static int8_t take(double& rest) {
+    int32_t d = constrain(lround(rest), -127L, 127L);
+    rest -= d;
+    if (noise > 0) {
+        d = constrain(d + (int32_t)(random() % (2 * noise + 1)) - noise,
+            -127, 127);
+    }
+    return d;
+}
+
+static bool pending() {
+    return (frameIx < frameLen && plugged) || lround(restX) != 0 ||
+        lround(restY) != 0 || buttons != sentButtons;
+}
+
+/*
+    Starts a new frame, if there's anything to tell. Motion is sent as is,
+    i.e. positive dy means down, and the protocol has it negated.
+ */
+static bool nextFrame() {
+
+    if (!pending()) {
+        return false;
+    }
+
+    frame[0] = DATA_FRAME_START | (~buttons & 0x07);
+    frameLen = fiveBytes ? 5 : 3;
+    frameIx = 0;
+    frameX = frameY = 0;
+    frameBroken = false;
+
+    for (uint8_t i = 1; i < frameLen; i += 2) {
+        int8_t dx = take(restX);
+        int8_t dy = take(restY);
+        frame[i] = dx;
+        frame[i + 1] = -dy;
+        frameX += dx;
+        frameY += dy;
+    }
+
+    if (buttons != sentButtons) {
+        stats.clicks++;
+        sentButtons = buttons;
+    }
+    return true;
+}
+
+/*
+    Returns the next byte for the line, or -1 if there's nothing to send.
+    Faults are applied here.
+ */
+static int nextByte() {
+
+    if (!plugged) {
+        return -1;
+    }
+
+    if (garbage > 0 && (uint8_t)(random() % 100) < garbage) {
+        stats.garbage++;
+        return random() & 0xFF;
+    }
+
+    while (frameIx == frameLen) {
+        if (!nextFrame()) {
+            return -1;
+        }
+    }
+
+    int b = frame[frameIx++];
+    if (drop > 0 && (uint8_t)(random() % 100) < drop) {
+        stats.dropped++;
+        frameBroken = true;
+        b = -2;
+    }
+
+    if (frameIx == frameLen) {
+        stats.frames++;
+        if (!frameBroken) {
+            stats.dx += frameX;
+            stats.dy += frameY;
+        }
+    }
+    return b;
+}
+
+// --- main ------------------------------------------------------------------
+
+static int openLine(const char* path, bool file) {
+
+    int f;
+    if (file) {
+        f = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else if (path != NULL) {
+        f = open(path, O_RDWR | O_NOCTTY);
+    } else {
+        f = posix_openpt(O_RDWR | O_NOCTTY);
+        if (f >= 0 && (grantpt(f) < 0 || unlockpt(f) < 0)) {
+            close(f);
+            f = -1;
+        }
+    }
+    if (f < 0) {
+        perror("sunmouse: opening output");
+        return -1;
+    }
+
+    struct termios tio;
+    if (!file && tcgetattr(f, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(f, TCSANOW, &tio);
+    }
+
+    if (!file && path == NULL) {
+        printf("%s\n", ptsname(f));
+        fflush(stdout);
+    }
+    return f;
+}
+
+int main(int argc, char** argv) {
+
+    const char* path = NULL;
+    bool file = false;
+    uint32_t baud = 1200;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vp:o:b:s:")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+            case 'p':
+            case 'o':
+                path = optarg;
+                file = opt == 'o';
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            case 's':
+                srandom(atol(optarg));
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v] [-p tty | -o file] "
+                    "[-b baud] [-s seed] script\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind == argc || baud == 0) {
+        fprintf(stderr, "sunmouse: no script given, or invalid baud rate\n");
+        return 1;
+    }
+
+    FILE* f = fopen(argv[optind], "r");
+    if (f == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    bool ok = parseScript(f);
+    fclose(f);
+    if (!ok) {
+        return 1;
+    }
+
+    int fd = openLine(path, file);
+    if (fd < 0) {
+        return 1;
+    }
+
+    // start bit, 8 data bits, 2 stop bits
+    uint64_t byteTime = 11 * 1000000ULL / baud;
+    uint64_t start = hostTime();
+    uint64_t t = 0; // when the line is free for the next byte
+    size_t next = 0;
+    bool running = true;
+
+    std::vector<uint8_t> out;
+    out.reserve(1 << 16);
+
+    while (running) {
+
+        // quitting waits for what's still to be sent
+        while (next < actions.size() && actions[next].at <= t &&
+            (actions[next].type != QUIT || !plugged || !pending())) {
+            running &= run(actions[next++]);
+        }
+        if (!running) {
+            break;
+        }
+
+        int b = nextByte();
+        if (b == -1) {
+            // idle until the next action
+            t = max(t, next < actions.size() ? actions[next].at : t);
+            continue;
+        }
+
+        if (b >= 0) {
+            if (file) {
+                out.push_back(b);
+            } else {
+                int64_t ahead = (int64_t)(start + t) - (int64_t)hostTime();
+                if (ahead > 0) {
+                    usleep(ahead);
+                }
+                uint8_t c = b;
+                if (write(fd, &c, 1) != 1) {
+                    usleep(byteTime); // nobody listening yet
+                }
+            }
+            if (verbose) {
+                fprintf(stderr, "sunmouse: %10.3f %02x\n", t / 1e3, b);
+            }
+            stats.bytes++;
+        }
+        t += byteTime;
+
+        if (file && out.size() >= (1 << 16)) {
+            ok &= write(fd, out.data(), out.size()) == (ssize_t)out.size();
+            out.clear();
+        }
+    }
+
+    if (file && !out.empty()) {
+        ok &= write(fd, out.data(), out.size()) == (ssize_t)out.size();
+    }
+    close(fd);
+
+    fprintf(stderr, "sunmouse: %.3fs, %llu bytes, %llu frames, %lld/%lld "
+        "moved, %u button changes\n", t / 1e6,
+        (unsigned long long)stats.bytes, (unsigned long long)stats.frames,
+        (long long)stats.dx, (long long)stats.dy, stats.clicks);
+    fprintf(stderr, "sunmouse: %llu bytes dropped, %llu garbage bytes, "
+        "%u unplugs, %llu frames cut off\n",
+        (unsigned long long)stats.dropped, (unsigned long long)stats.garbage,
+        stats.unplugs, (unsigned long long)stats.cut);
+
+    if (!ok) {
+        perror("sunmouse: writing output");
+    }
+    return ok ? 0 : 1;
+}
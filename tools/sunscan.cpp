@@ -0,0 +1,806 @@
+/*
+    sunscan - what the adapter would have sent, from captured SUN serial data
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+    Captures are the raw bytes a keyboard or mouse sent, e.g. read off a
+    serial port with cat. They're run through the sketch's SunPort and
+    KeyboardConverter, or its MouseConverter, in virtual time, as if the
+    bytes had come in back to back. Every report the adapter would have sent
+    to the host is printed, with the capture offset of the byte that caused
+    it, and the virtual time in milliseconds:
+
+        <offset> <ms> key <modifiers> 00 <key 1> ... <key 6>
+        <offset> <ms> mouse <buttons> <x> <y> <wheel> <pan>
+        <offset> <ms> consumer <usage>
+        <offset> <ms> system <usage>
+
+    Captures are memory mapped and cut into one chunk per CPU, each handled
+    by a forked worker, since the converters keep their state in globals.
+    Keyboard chunks start right after an idle code, i.e. with no keys held,
+    and with the layout the keyboard last reported before. Where a chunk
+    ends with the converter in any other state than a worker starts out in,
+    e.g. with Compose or a layer toggled on, the chunks after it are run
+    again in one go, until the converter has settled, see scanFile.
+    Mouse chunks start at a frame start, with some of the bytes before run
+    first without output, so protocol detection is warmed up. Cut points and
+    marker counts come from a vectorized scan, see scan.h.
+
+    usage: sunscan [-m] [-q] [-j jobs] [-b baud] file...
+
+        -m       captures are from a mouse, otherwise from a keyboard
+        -q       don't print reports, only statistics
+        -j jobs  number of workers, default is one per CPU
+        -b baud  baud rate of the captures, default 1200
+
+    Statistics, including anomalies, go to stderr once all files are done.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "keyboard.h"
+#include "keymap.h"
+#include "mouse.h"
+#include "recorder.h"
+#include "sun_codes.h"
+#include "sun_port.h"
+#include "usb_consumer.h"
+#include "scan.h"
+
+#define SELF_TEST_FAILED 0x7E
+#define MIN_CHUNK        (1 << 16)
+#define WARM_UP          64   // bytes run before a mouse chunk
+#define DRAIN            1000 // ms run after the end, for pending macros
+
+/*
+    Keyboard anomalies:
+
+     - resets:    reset responses, i.e. keyboard was reset or re-plugged
+     - selfTests: failed self tests
+     - repeats:   makes of keys already held, i.e. lost breaks or bounce
+     - orphans:   breaks of keys not held, i.e. lost makes
+     - stuck:     keys still held at an idle code, i.e. lost breaks
+
+    Mouse anomalies are the sketch's sync counters, see MouseSync. Starts
+    counts bytes looking like a frame start, compared with frames decoded
+    that tells how much of the data could be noise.
+ */
+struct Stats {
+    uint64_t bytes;
+    uint64_t reports;
+    uint64_t idles;
+    uint64_t layouts;
+    uint64_t resets;
+    uint64_t selfTests;
+    uint64_t repeats;
+    uint64_t orphans;
+    uint64_t stuck;
+    uint64_t starts;
+    uint64_t frames;
+    uint64_t misframes;
+    uint64_t dropped;
+    uint64_t switches;
+    uint64_t maxRecovery;
+};
+
+static bool mouse = false;
+static uint32_t byteTime;   // us per byte
+static FILE* out = NULL;    // where reports go, NULL while quiet
+static uint64_t offset = 0; // of the byte being handled
+static Stats* stats = NULL;
+
+// --- USB -------------------------------------------------------------------
+
+static void report(const char* type, const uint8_t* data, uint8_t len) {
+    stats->reports++;
+    if (out == NULL) {
+        return;
+    }
+    static const char hex[] = "0123456789abcdef";
+    char line[64];
+    uint64_t t = hostTime();
+    int n = snprintf(line, sizeof(line), "%llu %llu.%03u %s",
+        (unsigned long long)offset, (unsigned long long)(t / 1000),
+        (unsigned)(t % 1000), type);
+    for (uint8_t i = 0; i < len; i++) {
+        line[n++] = ' ';
+        line[n++] = hex[data[i] >> 4];
+        line[n++] = hex[data[i] & 0x0F];
+    }
+    line[n++] = '\n';
+    fwrite(line, 1, n, out);
+}
+
+/*
+    reportData isn't touched in here, since the converter's KeyReport may
+    have been constructed first and already set it.
+ */
+static unsigned long lastSend = ~0UL;
+
+USBKeyboard::USBKeyboard() : PluggableUSBModule(1, 1, epType) {}
+
+int USBKeyboard::getInterface(uint8_t* interfaceCount) {
+    return 0;
+}
+
+int USBKeyboard::getDescriptor(USBSetup& setup) {
+    return 0;
+}
+
+bool USBKeyboard::setup(USBSetup& setup) {
+    return false;
+}
+
+uint8_t USBKeyboard::getLeds() {
+    return 0;
+}
+
+uint8_t USBKeyboard::getProtocol() {
+    return 1;
+}
+
+void USBKeyboard::setFeatureReport(void* report, int length) {}
+
+int USBKeyboard::availableFeatureReport() {
+    return 0;
+}
+
+void USBKeyboard::enableFeatureReport() {}
+
+void USBKeyboard::disableFeatureReport() {}
+
+void USBKeyboard::setReportData(ReportData* data) {
+    reportData = data;
+}
+
+/*
+    The host polls once per millisecond, so that's how fast macros go.
+ */
+bool USBKeyboard::ready() {
+    return millis() != lastSend;
+}
+
+int USBKeyboard::send() {
+    if (stats != NULL && reportData != NULL) {
+        lastSend = millis();
+        report("key", (const uint8_t*)reportData, sizeof(ReportData));
+    }
+    return 0;
+}
+
+void USBKeyboard::wakeupHost() {}
+
+USBKeyboard usbKeyboard;
+
+USBMouse::USBMouse() : buttons(0) {}
+
+void USBMouse::send(uint8_t x, uint8_t y, uint8_t v, uint8_t h) {
+    uint8_t data[] = {buttons, x, y, v, h};
+    report("mouse", data, sizeof(data));
+}
+
+void USBMouse::setButtons(uint8_t b) {
+    if (b != buttons) {
+        buttons = b;
+        send(0, 0, 0, 0);
+    }
+}
+
+void USBMouse::move(signed char x, signed char y) {
+    send(x, y, 0, 0);
+}
+
+void USBMouse::scroll(signed char v, signed char h) {
+    send(0, 0, v, h);
+}
+
+void USBMouse::press(uint8_t b) {
+    setButtons(buttons | b);
+}
+
+void USBMouse::release(uint8_t b) {
+    setButtons(buttons & ~b);
+}
+
+USBMouse usbMouse;
+
+USBConsumer::USBConsumer() {
+    usages[CONSUMER_CONTROL] = 0;
+    usages[SYSTEM_CONTROL] = 0;
+}
+
+void USBConsumer::handleUsage(uint8_t report, uint8_t usage, bool pressed) {
+    if (pressed) {
+        usages[report] = usage;
+    } else if (usages[report] == usage) {
+        usages[report] = 0;
+    } else {
+        return;
+    }
+    send(report);
+}
+
+void USBConsumer::releaseAll() {
+    for (uint8_t r = CONSUMER_CONTROL; r <= SYSTEM_CONTROL; r++) {
+        if (usages[r] != 0) {
+            usages[r] = 0;
+            send(r);
+        }
+    }
+}
+
+void USBConsumer::send(uint8_t report) {
+    if (stats != NULL) {
+        ::report(report == CONSUMER_CONTROL ? "consumer" : "system",
+            &usages[report], 1);
+    }
+}
+
+USBConsumer usbConsumer;
+
+// --- keyboard --------------------------------------------------------------
+
+/*
+    Hands the capture to SunPort one byte at a time. What the port sends to
+    the keyboard, i.e. LED changes, goes nowhere.
+ */
+class CaptureStream : public Stream {
+public:
+    int next = -1;
+    int available() { return next >= 0; }
+    int read() { int b = next; next = -1; return b; }
+    size_t write(uint8_t b) { return 1; }
+};
+
+static CaptureStream capture;
+static SunPort port(capture);
+
+// what the sketch provides in suniversal.ino
+void resetKeyboard() {}
+
+void toggleLEDs(uint8_t mask) {
+    port.toggleLEDs(mask);
+}
+
+uint8_t getLEDs() {
+    return port.getLEDs();
+}
+
+/*
+    Layout as the keyboard reports it.
+ */
+static void setLayout(uint8_t b) {
+#if USE_MACROS == true
+    if (FORCE_LAYOUT == GET_FROM_KEYBOARD) {
+        keyboardConverter.setLayout(b & 0x1F);
+    }
+#endif
+}
+
+/*
+    Keeps its own account of held keys for spotting anomalies. Unlike the
+    adapter, it knows responses aren't keys, so only returns true for keys
+    and idle codes, which go on to the converter.
+ */
+static uint8_t held[16];
+static uint8_t skip = 0;
+static bool layout = false;
+
+static bool checkKey(uint8_t b) {
+
+    if (layout) {
+        // the adapter asks for this at reset, so it's from a reset capture
+        layout = false;
+        setLayout(b);
+        return false;
+    }
+
+    if (skip > 0) {
+        skip--;
+        return false;
+    }
+
+    switch (b) {
+        case KBD_RESET_RESP: // followed by 0x04 and 0x7F or held key
+            skip = 2;
+            return false;
+        case KBD_LAYOUT_RESP: // followed by layout
+            layout = true;
+            return false;
+        case SELF_TEST_FAILED: // followed by 0x01
+            skip = 1;
+            return false;
+        case KBD_IDLE:
+            for (uint8_t i = 0; i < sizeof(held); i++) {
+                stats->stuck += __builtin_popcount(held[i]);
+            }
+            memset(held, 0, sizeof(held));
+            return true;
+    }
+
+    uint8_t key = b & ~BREAK_BIT;
+    uint8_t bit = 1 << (key & 0x07);
+    if ((b & BREAK_BIT) == 0) {
+        if (held[key >> 3] & bit) {
+            stats->repeats++;
+        }
+        held[key >> 3] |= bit;
+    } else {
+        if ((held[key >> 3] & bit) == 0) {
+            stats->orphans++;
+        }
+        held[key >> 3] &= ~bit;
+    }
+    return true;
+}
+
+static void handleKeyboard(uint8_t b) {
+    if (checkKey(b)) {
+        capture.next = b;
+        port.update();
+    }
+}
+
+// --- mouse -----------------------------------------------------------------
+
+/*
+    The sketch's sync counters are only 16 bits, so they're moved over to
+    the stats every now and then.
+ */
+static void collectSync() {
+    stats->frames += mouseSync.frames;
+    stats->misframes += mouseSync.misframes;
+    stats->dropped += mouseSync.dropped;
+    stats->switches += mouseSync.switches;
+    stats->maxRecovery = max(stats->maxRecovery,
+        (uint64_t)mouseSync.maxRecovery);
+    memset(&mouseSync, 0, sizeof(mouseSync));
+}
+
+// --- workers ---------------------------------------------------------------
+
+/*
+    Ticks the converter at t, if it has anything to do.
+ */
+static bool tick(uint64_t t) {
+    if (mouse ? !mouseConverter.busy() : !keyboardConverter.busy()) {
+        return false;
+    }
+    hostSetTime(t);
+    if (mouse) {
+        mouseConverter.tick();
+    } else {
+        keyboardConverter.tick();
+    }
+    return true;
+}
+
+/*
+    EEPROM as the worker started out with it, see settled.
+ */
+static uint8_t eeprom[E2END + 1];
+
+/*
+    Whether the converter is in the state a worker starts out in, other than
+    the keyboard layout, which is carried over, see findLayouts. That's with
+    nothing still going on, no LEDs on, e.g. for Compose, no layers
+    toggled on, nothing being recorded, and nothing new in EEPROM. Mice
+    don't remember anything across frames that matters here.
+ */
+static bool settled() {
+    if (mouse) {
+        return true;
+    }
+    return !keyboardConverter.busy() && port.getLEDs() == 0 &&
+        keymap.toggled() == 0 && !recorder.isRecording() &&
+        memcmp(eeprom, EEPROM.data, sizeof(eeprom)) == 0;
+}
+
+/*
+    What a worker found, in memory shared with the parent.
+ */
+struct Result {
+    Stats stats;
+    size_t end;   // where it stopped
+    bool settled; // at end
+};
+
+/*
+    Runs a capture, which starts at data, from begin on, up to the first of
+    count stops where the converter has settled, or the last one. Bytes from
+    warm on are run first, without output or stats, with the keyboard layout
+    set to startLayout, unless that's -1.
+ */
+static void work(const uint8_t* data, const uint8_t* warm,
+    const uint8_t* begin, const size_t* stops, int count, int startLayout,
+    FILE* reports, Result* result) {
+
+    // as in the sketch's setup
+#if USE_USER_KEYMAP == true
+    keymap.begin();
+#endif
+#if USE_RECORDER == true
+    recorder.begin();
+#endif
+    memcpy(eeprom, EEPROM.data, sizeof(eeprom));
+    if (startLayout >= 0) {
+        setLayout(startLayout);
+    }
+
+    Stats quiet;
+    memset(&quiet, 0, sizeof(quiet));
+    stats = &quiet;
+
+    const uint8_t* end = data + stops[count - 1];
+    int stop = 0;
+
+    for (const uint8_t* p = warm; p < end; p++) {
+
+        if (p == begin) {
+            stats = &result->stats;
+            out = reports;
+            if (mouse) {
+                memset(&mouseSync, 0, sizeof(mouseSync));
+            }
+        }
+
+        if (p == data + stops[stop]) {
+            if (settled()) {
+                end = p;
+                break;
+            }
+            stop++;
+        }
+
+        offset = p - data;
+        uint64_t at = offset * byteTime;
+        hostSetTime(at);
+
+        if (mouse) {
+            mouseConverter.update(*p, false);
+            if ((offset & 0xFFF) == 0) {
+                collectSync();
+            }
+        } else {
+            handleKeyboard(*p);
+        }
+
+        // the adapter's loop runs all the time, but a tick per ms will do,
+        // and only while a stage is waiting for something
+        for (uint64_t t = at; t < at + byteTime; t += 1000) {
+            if (!tick(t)) {
+                break;
+            }
+        }
+    }
+
+    result->end = end - data;
+    result->settled = settled();
+
+    // for keyboards, anything still pending when not at the end of the
+    // capture means the run wasn't settled, and is going to be replaced
+    uint64_t at = (uint64_t)(end - data) * byteTime;
+    for (uint32_t ms = 0; ms < DRAIN; ms++) {
+        if (!tick(at + ms * 1000)) {
+            break;
+        }
+    }
+
+    if (mouse) {
+        collectSync();
+        stats->starts = countBytes(begin, end, FRAME_START_MASK,
+            DATA_FRAME_START);
+    } else {
+        stats->idles = countBytes(begin, end, 0xFF, KBD_IDLE);
+        stats->layouts = countBytes(begin, end, 0xFF, KBD_LAYOUT_RESP);
+        stats->resets = countBytes(begin, end, 0xFF, KBD_RESET_RESP);
+        stats->selfTests = countBytes(begin, end, 0xFF, SELF_TEST_FAILED);
+    }
+    stats->bytes = end - begin;
+}
+
+/*
+    Forks a worker for work, with its result going to result.
+ */
+static pid_t spawn(const uint8_t* data, const uint8_t* warm,
+    const uint8_t* begin, const size_t* stops, int count, int startLayout,
+    FILE* reports, Result* result) {
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        work(data, warm, begin, stops, count, startLayout, reports, result);
+        if (reports != NULL) {
+            fflush(reports);
+        }
+        _exit(0);
+    }
+    return pid;
+}
+
+static bool finished(pid_t pid) {
+    int status;
+    return pid >= 0 && waitpid(pid, &status, 0) >= 0 &&
+        WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+    Cuts [0, size) into up to jobs chunks, at places where the converters
+    can start over. Returns the number of chunks, cuts gets their starts,
+    plus size at the end.
+ */
+static int cut(const uint8_t* data, size_t size, int jobs, size_t* cuts) {
+
+    int n = 1;
+    cuts[0] = 0;
+
+    for (int i = 1; i < jobs && size / jobs >= MIN_CHUNK; i++) {
+        const uint8_t* from = data + max(size * i / jobs, cuts[n - 1] + 1);
+        const uint8_t* end = data + size;
+        const uint8_t* p = mouse ?
+            findByte(from, end, FRAME_START_MASK, DATA_FRAME_START) :
+            findByte(from, end, 0xFF, KBD_IDLE) + 1;
+        if (p >= end) {
+            break;
+        }
+        cuts[n++] = p - data;
+    }
+
+    cuts[n] = size;
+    return n;
+}
+
+/*
+    The layout the keyboard last reported before each of n chunks, -1 if
+    none.
+ */
+static void findLayouts(const uint8_t* data, size_t size, const size_t* cuts,
+    int n, int* layouts) {
+
+    int layout = -1;
+    for (int i = 0; i < n; i++) {
+        layouts[i] = layout;
+        const uint8_t* end = data + cuts[i + 1];
+        const uint8_t* p = data + cuts[i];
+        while ((p = findByte(p, end, 0xFF, KBD_LAYOUT_RESP)) < end) {
+            if (++p < data + size) {
+                layout = *p;
+            }
+        }
+    }
+}
+
+static bool scanFile(const char* path, int jobs, bool quiet, Stats& total) {
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+
+    const uint8_t* data = (const uint8_t*)mmap(NULL, size, PROT_READ,
+        MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    size_t* cuts = new size_t[jobs + 1];
+    int n = cut(data, size, jobs, cuts);
+    int* layouts = new int[n];
+    if (mouse) {
+        memset(layouts, 0xFF, n * sizeof(int));
+    } else {
+        findLayouts(data, size, cuts, n, layouts);
+    }
+
+    Result* results = (Result*)mmap(NULL, n * sizeof(Result),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    FILE** reports = new FILE*[n];
+    pid_t* workers = new pid_t[n];
+
+    for (int i = 0; i < n; i++) {
+        reports[i] = quiet ? NULL : tmpfile();
+        const uint8_t* begin = data + cuts[i];
+        const uint8_t* warm = begin;
+        if (mouse && i > 0) {
+            warm = max(begin - WARM_UP, data + cuts[i - 1]);
+        }
+        workers[i] = spawn(data, warm, begin, &cuts[i + 1], 1, layouts[i],
+            reports[i], &results[i]);
+    }
+
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        if (!finished(workers[i])) {
+            fprintf(stderr, "sunscan: %s: worker %d failed\n", path, i);
+            ok = false;
+        }
+    }
+
+    // A chunk is only right if the one before ended with the converter
+    // settled. Where it didn't, the chunks following are run again in one
+    // go, warmed up with the last chunk that's right, until the converter
+    // has settled, or to the end of the capture.
+    for (int i = 0; ok && i < n - 1; i++) {
+        if (results[i].settled || results[i].end == size) {
+            continue;
+        }
+        memset(&results[i + 1], 0, sizeof(Result));
+        if (reports[i + 1] != NULL) {
+            fclose(reports[i + 1]);
+            reports[i + 1] = tmpfile();
+        }
+        pid_t pid = spawn(data, data + cuts[i], data + cuts[i + 1],
+            &cuts[i + 2], n - i - 1, layouts[i], reports[i + 1],
+            &results[i + 1]);
+        if (!finished(pid)) {
+            fprintf(stderr, "sunscan: %s: worker %d failed\n", path, i + 1);
+            ok = false;
+        }
+        // drop the chunks the run covered
+        for (int j = i + 2; j < n && cuts[j] < results[i + 1].end; j++) {
+            memset(&results[j], 0, sizeof(Result));
+            results[j].settled = true;
+            if (reports[j] != NULL) {
+                fclose(reports[j]);
+                reports[j] = NULL;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (reports[i] != NULL) {
+            char buf[1 << 16];
+            size_t len;
+            rewind(reports[i]);
+            while ((len = fread(buf, 1, sizeof(buf), reports[i])) > 0) {
+                fwrite(buf, 1, len, stdout);
+            }
+            fclose(reports[i]);
+        }
+        // all counters add up, except for the max
+        Stats& s = results[i].stats;
+        uint64_t maxRecovery = max(total.maxRecovery, s.maxRecovery);
+        uint64_t* to = (uint64_t*)&total;
+        uint64_t* from = (uint64_t*)&s;
+        for (size_t j = 0; j < sizeof(Stats) / sizeof(uint64_t); j++) {
+            to[j] += from[j];
+        }
+        total.maxRecovery = maxRecovery;
+    }
+
+    munmap((void*)results, n * sizeof(Result));
+    munmap((void*)data, size);
+    delete[] workers;
+    delete[] reports;
+    delete[] layouts;
+    delete[] cuts;
+    return ok;
+}
+
+// --- main ------------------------------------------------------------------
+
+static void printStats(Stats& s, double seconds) {
+
+    fprintf(stderr, "sunscan: %llu bytes in %.2fs, %.1f MB/s, %llu reports\n",
+        (unsigned long long)s.bytes, seconds,
+        seconds > 0 ? s.bytes / seconds / 1e6 : 0.0,
+        (unsigned long long)s.reports);
+
+    if (mouse) {
+        fprintf(stderr, "sunscan: %llu frames, %llu frame starts, "
+            "%llu misframes, %llu dropped bytes, %llu protocol switches, "
+            "max recovery %llu bytes (%.1fms)\n", (unsigned long long)s.frames,
+            (unsigned long long)s.starts, (unsigned long long)s.misframes,
+            (unsigned long long)s.dropped, (unsigned long long)s.switches,
+            (unsigned long long)s.maxRecovery, s.maxRecovery * byteTime / 1e3);
+    } else {
+        fprintf(stderr, "sunscan: %llu idles, %llu layout responses, "
+            "%llu resets, %llu failed self tests, %llu repeated makes, "
+            "%llu orphan breaks, %llu keys stuck at idle\n",
+            (unsigned long long)s.idles, (unsigned long long)s.layouts,
+            (unsigned long long)s.resets, (unsigned long long)s.selfTests,
+            (unsigned long long)s.repeats, (unsigned long long)s.orphans,
+            (unsigned long long)s.stuck);
+    }
+}
+
+int main(int argc, char** argv) {
+
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t baud = 1200;
+    bool quiet = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "mqj:b:")) != -1) {
+        switch (opt) {
+            case 'm':
+                mouse = true;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m] [-q] [-j jobs] [-b baud] "
+                    "file...\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind == argc) {
+        fprintf(stderr, "sunscan: no captures given\n");
+        return 1;
+    }
+    if (jobs < 1 || baud == 0) {
+        fprintf(stderr, "sunscan: invalid jobs or baud rate\n");
+        return 1;
+    }
+
+    // start, data, and stop bits; mice use two stop bits
+    byteTime = (mouse ? 11 : 10) * 1000000UL / baud;
+    hostUseVirtualTime(true);
+
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Stats total;
+    memset(&total, 0, sizeof(total));
+    bool ok = true;
+    for (int i = optind; i < argc; i++) {
+        ok &= scanFile(argv[i], jobs, quiet, total);
+    }
+
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    printStats(total, (done.tv_sec - start.tv_sec) +
+        (done.tv_nsec - start.tv_nsec) / 1e9);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+/*
+    translate - SUN scan codes to USB codes, for the host tools
+    Copyright (c) 2018, Alexander Vollschwitz
+
+    This file is part of suniversal.
+
+    suniversal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    suniversal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with suniversal. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSLATE_h
+#define TRANSLATE_h
+
+#include <Arduino.h>
+
+#include "sun_to_usb.h"
+#include "sun_codes.h"
+
+/*
+    The tools use the sketch's sun2usb table as is. Codes for features that
+    only exist in the firmware are turned back into plain keys: macros into
+    the fun cluster key they sit on, the leader key into Help, and consumer
+    & system control usages into the keyboard's media & power keys. Layer,
+    recorder, and mouse keys give 0.
+
+    Returns modifiers in the high byte and the USB key in the low byte.
+ */
+static const uint8_t macroKeys[END_OF_MACROS] = {
+    USB_AGAIN, USB_UNDO, USB_COPY, USB_PASTE, USB_CUT, USB_STOP, USB_PROPS,
+    USB_FRONT, USB_OPEN, USB_FIND, USB_HELP
+};
+
+inline uint16_t mediaToUsb(uint16_t code) {
+    switch (code) {
+        case CONSUMER_CODE(USB_CONSUMER_VOLUMEUP): return USB_VOLUMEUP;
+        case CONSUMER_CODE(USB_CONSUMER_VOLUMEDOWN): return USB_VOLUMEDOWN;
+        case CONSUMER_CODE(USB_CONSUMER_MUTE): return USB_MUTE;
+        case CONSUMER_CODE(USB_CONSUMER_PLAYPAUSE): return USB_MEDIA_PLAYPAUSE;
+        case CONSUMER_CODE(USB_CONSUMER_STOP): return USB_MEDIA_STOPCD;
+        case CONSUMER_CODE(USB_CONSUMER_PREVIOUSSONG):
+            return USB_MEDIA_PREVIOUSSONG;
+        case CONSUMER_CODE(USB_CONSUMER_NEXTSONG): return USB_MEDIA_NEXTSONG;
+        case SYSTEM_CODE(USB_SYSTEM_POWER): return USB_POWER;
+        case SYSTEM_CODE(USB_SYSTEM_SLEEP): return USB_MEDIA_SLEEP;
+    }
+    return 0;
+}
+
+inline uint16_t sunToUsb(uint8_t key) {
+    uint16_t code = pgm_read_word(&sun2usb[key & 0x7F]);
+    switch (code >> 8) {
+        case 0xFF:
+            return (code & 0xFF) < END_OF_MACROS ? macroKeys[code & 0xFF] : 0;
+        case 0xFD:
+            return USB_HELP;
+        case 0xFA:
+        case 0xF9:
+            return mediaToUsb(code);
+        case 0xFE:
+        case 0xFC:
+        case 0xFB:
+            return 0;
+    }
+    return code;
+}
+
+#endif